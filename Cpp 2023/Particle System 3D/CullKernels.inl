@@ -0,0 +1,56 @@
+// Frustum culling, written once against the same Ops as ForceKernels.inl
+// and included after it in each SIMD level's namespace.
+
+inline Ops::Float PlaneDistance(Ops::Float x, Ops::Float y, Ops::Float z, Ops::Float normalX, Ops::Float normalY,
+    Ops::Float normalZ, Ops::Float distance) {
+    return Ops::Add(Ops::Add(Ops::Add(Ops::Mul(x, normalX), Ops::Mul(y, normalY)), Ops::Mul(z, normalZ)), distance);
+}
+
+// Appends the indices of the visible live particles in [begin, span.count)
+// to visible, which already holds result.visible of them, and adds to the
+// counts in result. A particle is visible when it is no further than margin
+// outside any plane.
+inline CullResult CullRange(const ConstParticleSpan& columns, size_t begin, float lookahead, const Frustum& frustum,
+    float margin, uint32_t* visible, CullResult result) {
+    const ConstParticleSpan span = columns;
+    const Ops::Float ahead = Ops::Set(lookahead);
+    const Ops::Float zero = Ops::Zero();
+    Ops::Float normalX[6], normalY[6], normalZ[6], distance[6];
+    for (size_t k = 0; k < 6; ++k) {
+        normalX[k] = Ops::Set(frustum.planes[k].x);
+        normalY[k] = Ops::Set(frustum.planes[k].y);
+        normalZ[k] = Ops::Set(frustum.planes[k].z);
+        distance[k] = Ops::Set(frustum.planes[k].w + margin);
+    }
+
+    size_t i = begin;
+    for (; i + Ops::WIDTH <= span.count; i += Ops::WIDTH) {
+        Ops::Float x = Ops::Add(Ops::Load(span.positionX + i), Ops::Mul(Ops::Load(span.velocityX + i), ahead));
+        Ops::Float y = Ops::Add(Ops::Load(span.positionY + i), Ops::Mul(Ops::Load(span.velocityY + i), ahead));
+        Ops::Float z = Ops::Add(Ops::Load(span.positionZ + i), Ops::Mul(Ops::Load(span.velocityZ + i), ahead));
+
+        // Inside all six planes when inside the nearest one.
+        Ops::Float nearest = PlaneDistance(x, y, z, normalX[0], normalY[0], normalZ[0], distance[0]);
+        for (size_t k = 1; k < 6; ++k)
+            nearest = Ops::Min(nearest, PlaneDistance(x, y, z, normalX[k], normalY[k], normalZ[k], distance[k]));
+        int alive = Ops::GreaterMask(Ops::Load(span.life + i), zero);
+        int lanes = Ops::GreaterEqualMask(nearest, zero) & alive;
+        result.live += Ops::CountLanes(alive);
+        if (lanes == 0)
+            continue;
+
+        // Every lane is written and only visible ones are kept, so there is
+        // no branch per particle. The count never passes i + lane, so the
+        // writes stay within span.count.
+        size_t found = result.visible;
+        for (size_t lane = 0; lane < Ops::WIDTH; ++lane) {
+            visible[found] = static_cast<uint32_t>(i + lane);
+            found += (lanes >> lane) & 1;
+        }
+        result.visible = found;
+    }
+
+    if constexpr (Ops::WIDTH > 1)
+        result = scalar::CullRange(span, i, lookahead, frustum, margin, visible, result);
+    return result;
+}
@@ -0,0 +1,309 @@
+#include "DepthSorter.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <utility>
+#include "WorkerPool.h"
+
+namespace {
+    const size_t RADIX_BUCKETS = 256;
+    // Below this, sorting on one thread beats waking the pool.
+    const size_t PARALLEL_SORT_MIN_PARTICLES = 65536;
+    // Pairs of last frame's order that are rekeyed to decide whether it is
+    // still worth starting from...
+    const size_t INCREMENTAL_PROBES = 256;
+    // ...which it is when at most one pair in this many swapped places. A
+    // shuffled order swaps every other pair.
+    const size_t INCREMENTAL_MAX_DESCENT_RATIO = 4;
+    // A bucket's insertion pass gives up after this many moves per particle.
+    const size_t INSERTION_MOVES_PER_PARTICLE = 8;
+    // Every this many sorts the path that was slower is timed again, in
+    // case the scene changed.
+    const uint32_t PATH_RETRIAL_INTERVAL = 16;
+    // Weight of the newest sort in each path's running cost.
+    const double PATH_COST_WEIGHT = 0.25;
+
+    // The bits of a float, flipped so they order like the values: negatives
+    // reversed and below the positives.
+    uint32_t DepthKey(float depth) {
+        uint32_t bits;
+        std::memcpy(&bits, &depth, sizeof(bits));
+        uint32_t flip = static_cast<uint32_t>(-static_cast<int32_t>(bits >> 31)) | 0x80000000u;
+        return bits ^ flip;
+    }
+
+    // Returns false when it ran out of moves, which leaves the entries
+    // reordered but not sorted.
+    bool InsertionSort(uint64_t* sorted, size_t count) {
+        size_t budget = count * INSERTION_MOVES_PER_PARTICLE;
+        for (size_t k = 1; k < count; ++k) {
+            uint64_t entry = sorted[k];
+            size_t j = k;
+            while (j > 0 && sorted[j - 1] > entry && k - j < budget) {
+                sorted[j] = sorted[j - 1];
+                --j;
+            }
+            sorted[j] = entry;
+            if (j > 0 && sorted[j - 1] > entry)
+                return false;
+            budget -= k - j;
+        }
+        return true;
+    }
+
+    // Serial LSD radix sort of entries on the key bits in varyingBits, with
+    // temp as room for the scatter. The result ends up in entries.
+    void RadixSortRange(uint64_t* entries, uint64_t* temp, size_t count, uint32_t varyingBits) {
+        uint32_t counts[RADIX_BUCKETS];
+        uint64_t* source = entries;
+        uint64_t* target = temp;
+        for (int shift = 32; shift < 64; shift += 8) {
+            if (((varyingBits >> (shift - 32)) & 0xff) == 0)
+                continue;
+            std::fill(counts, counts + RADIX_BUCKETS, 0u);
+            for (size_t k = 0; k < count; ++k)
+                ++counts[(source[k] >> shift) & 0xff];
+            uint32_t offset = 0;
+            for (size_t digit = 0; digit < RADIX_BUCKETS; ++digit) {
+                uint32_t digitCount = counts[digit];
+                counts[digit] = offset;
+                offset += digitCount;
+            }
+            for (size_t k = 0; k < count; ++k)
+                target[counts[(source[k] >> shift) & 0xff]++] = source[k];
+            std::swap(source, target);
+        }
+        if (source != entries)
+            std::copy(source, source + count, entries);
+    }
+}
+
+DepthSorter::DepthSorter() : workerPool(nullptr), mark(0), carriedCost(0.0), freshCost(0.0), sortsSinceTrial(0) {}
+
+DepthSortResult DepthSorter::Sort(const ConstParticleSpan& particles, const uint32_t* indices, size_t count,
+    float lookahead, const glm::mat4& view) {
+    if (slots.size() < particles.count)
+        slots.resize(particles.count, SlotKey());
+    // Two marks per sort: listed, and listed and carried over.
+    mark += 2;
+    if (mark < 2) {
+        std::fill(slots.begin(), slots.end(), SlotKey());
+        mark = 2;
+    }
+
+    // Keyed in list order, which is slot order after culling, so the columns
+    // are read front to back. The camera looks down -z of its view space, so
+    // the furthest particle has the lowest z and ascending keys are back to
+    // front.
+    const float zx = view[0][2], zy = view[1][2], zz = view[2][2], zw = view[3][2];
+    uint32_t keyOr = 0, keyAnd = ~0u;
+    for (size_t k = 0; k < count; ++k) {
+        uint32_t i = indices[k];
+        float z = zx * (particles.positionX[i] + particles.velocityX[i] * lookahead)
+            + zy * (particles.positionY[i] + particles.velocityY[i] * lookahead)
+            + zz * (particles.positionZ[i] + particles.velocityZ[i] * lookahead) + zw;
+        uint32_t key = DepthKey(z);
+        slots[i].mark = mark;
+        slots[i].key = key;
+        keyOr |= key;
+        keyAnd &= key;
+    }
+
+    DepthSortResult result;
+    bool reuse = CarriedOrderSorted(particles.count) && PreferCarriedOrder();
+    auto pathStart = std::chrono::steady_clock::now();
+    if (reuse) {
+        // Particles still listed keep last frame's place; the rest follow.
+        size_t previous = entries.size();
+        if (previous < count)
+            entries.resize(count);
+        size_t kept = 0;
+        for (size_t k = 0; k < previous; ++k) {
+            uint32_t i = static_cast<uint32_t>(entries[k]);
+            if (i < particles.count && slots[i].mark == mark) {
+                slots[i].mark = mark + 1;
+                entries[kept++] = static_cast<uint64_t>(slots[i].key) << 32 | i;
+            }
+        }
+        for (size_t k = 0; k < count; ++k) {
+            uint32_t i = indices[k];
+            if (slots[i].mark == mark)
+                entries[kept++] = static_cast<uint64_t>(slots[i].key) << 32 | i;
+        }
+        entries.resize(kept);
+        result.count = kept;
+        result.reusedOrder = true;
+        RefineCarriedOrder(kept, keyOr ^ keyAnd, result);
+    }
+    else {
+        entries.resize(count);
+        for (size_t k = 0; k < count; ++k)
+            entries[k] = static_cast<uint64_t>(slots[indices[k]].key) << 32 | indices[k];
+        result.count = count;
+        result.radixPasses = RadixSort(count, keyOr ^ keyAnd);
+    }
+    if (result.count != 0) {
+        double cost = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - pathStart).count()
+            / static_cast<double>(result.count);
+        double& pathCost = reuse ? carriedCost : freshCost;
+        pathCost = pathCost == 0.0 ? cost : pathCost + (cost - pathCost) * PATH_COST_WEIGHT;
+    }
+
+    order.resize(result.count);
+    for (size_t k = 0; k < result.count; ++k)
+        order[k] = static_cast<uint32_t>(entries[k]);
+    return result;
+}
+
+// Compares the new keys of evenly spread pairs of last frame's order, each
+// a probe stride apart, and says whether few enough of them swapped places
+// for that order to be a better start than slot order. Smooth motion
+// shuffles close neighbours but keeps the order at that scale, which is
+// what the buckets need. Carrying the old order over reads the keys out of
+// slot order, so the guess has to be likely right.
+bool DepthSorter::CarriedOrderSorted(size_t slotCount) const {
+    size_t previous = entries.size();
+    if (previous < 2)
+        return false;
+    size_t stride = std::max<size_t>(1, (previous - 1) / INCREMENTAL_PROBES);
+    size_t pairs = 0, descents = 0;
+    for (size_t k = 0; k + stride < previous; k += stride) {
+        uint32_t first = static_cast<uint32_t>(entries[k]);
+        uint32_t second = static_cast<uint32_t>(entries[k + stride]);
+        if (first >= slotCount || second >= slotCount || slots[first].mark != mark || slots[second].mark != mark)
+            continue;
+        ++pairs;
+        uint64_t firstEntry = static_cast<uint64_t>(slots[first].key) << 32 | first;
+        uint64_t secondEntry = static_cast<uint64_t>(slots[second].key) << 32 | second;
+        descents += secondEntry < firstEntry;
+    }
+    return pairs > 0 && descents * INCREMENTAL_MAX_DESCENT_RATIO <= pairs;
+}
+
+// Both paths are timed per particle as they run. Under fast motion the
+// buckets need as many moves as a radix sort costs, so the previous order is
+// only reused while that has been the cheaper path, with the slower one
+// retried now and then.
+bool DepthSorter::PreferCarriedOrder() {
+    if (carriedCost == 0.0 || freshCost == 0.0)
+        return carriedCost == 0.0;
+    if (++sortsSinceTrial >= PATH_RETRIAL_INTERVAL) {
+        sortsSinceTrial = 0;
+        return carriedCost > freshCost;
+    }
+    return carriedCost <= freshCost;
+}
+
+// One stable counting pass on the top 8 varying key bits, reading the
+// carried order front to back. Since that order is nearly sorted, the
+// scatter mostly writes each bucket sequentially. Every bucket then only
+// needs ordering on the bits below, starting from last frame's order.
+void DepthSorter::RefineCarriedOrder(size_t count, uint32_t varyingBits, DepthSortResult& result) {
+    if (count < 2)
+        return;
+    int topBit = 31;
+    while (topBit > 0 && ((varyingBits >> topBit) & 1) == 0)
+        --topBit;
+    int digitShift = std::max(0, topBit - 7);
+    int shift = 32 + digitShift;
+    uint32_t lowBits = varyingBits & ((1u << digitShift) - 1u);
+
+    scratch.resize(count);
+    uint32_t starts[RADIX_BUCKETS + 1] = {};
+    for (size_t k = 0; k < count; ++k)
+        ++starts[((entries[k] >> shift) & 0xff) + 1];
+    for (size_t digit = 0; digit < RADIX_BUCKETS; ++digit)
+        starts[digit + 1] += starts[digit];
+    uint32_t offsets[RADIX_BUCKETS];
+    std::copy(starts, starts + RADIX_BUCKETS, offsets);
+    for (size_t k = 0; k < count; ++k) {
+        uint64_t entry = entries[k];
+        scratch[offsets[(entry >> shift) & 0xff]++] = entry;
+    }
+    entries.swap(scratch);
+
+    // Each bucket uses its own range of scratch for a radix sort.
+    std::atomic<size_t> radixBuckets(0), insertedBuckets(0);
+    auto finishBuckets = [&](size_t firstBucket, size_t endBucket) {
+        for (size_t digit = firstBucket; digit < endBucket; ++digit) {
+            size_t bucketBegin = starts[digit], bucketCount = starts[digit + 1] - bucketBegin;
+            if (bucketCount == 0)
+                continue;
+            if (InsertionSort(entries.data() + bucketBegin, bucketCount)) {
+                insertedBuckets.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            RadixSortRange(entries.data() + bucketBegin, scratch.data() + bucketBegin, bucketCount, lowBits);
+            radixBuckets.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+    if (workerPool != nullptr && count >= PARALLEL_SORT_MIN_PARTICLES)
+        workerPool->ParallelFor(RADIX_BUCKETS, RADIX_BUCKETS / (workerPool->ThreadCount() * 4) + 1, finishBuckets);
+    else
+        finishBuckets(0, RADIX_BUCKETS);
+
+    result.insertedBuckets = insertedBuckets.load(std::memory_order_relaxed);
+    result.radixBuckets = radixBuckets.load(std::memory_order_relaxed);
+    result.incremental = result.radixBuckets == 0;
+}
+
+// One counting pass and one scatter pass per digit. Each chunk counts its
+// own digits and scatters to offsets laid out digit by digit, then chunk by
+// chunk, so the parallel sort is as stable as the serial one. Digits that
+// no key differs in are skipped.
+int DepthSorter::RadixSort(size_t count, uint32_t varyingBits) {
+    if (count == 0)
+        return 0;
+    scratch.resize(count);
+    size_t chunkCount = workerPool != nullptr && count >= PARALLEL_SORT_MIN_PARTICLES ? workerPool->ThreadCount() : 1;
+    size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+    chunkCount = (count + chunkSize - 1) / chunkSize;
+    histograms.resize(chunkCount * RADIX_BUCKETS);
+
+    auto forEachChunk = [&](const auto& job) {
+        if (chunkCount == 1)
+            job(0, count);
+        else
+            workerPool->ParallelFor(count, chunkSize, job);
+    };
+
+    uint64_t* source = entries.data();
+    uint64_t* target = scratch.data();
+    int passes = 0;
+    for (int shift = 32; shift < 64; shift += 8) {
+        if (((varyingBits >> (shift - 32)) & 0xff) == 0)
+            continue;
+
+        forEachChunk([&](size_t begin, size_t end) {
+            uint32_t* counts = histograms.data() + begin / chunkSize * RADIX_BUCKETS;
+            std::fill(counts, counts + RADIX_BUCKETS, 0u);
+            for (size_t k = begin; k < end; ++k)
+                ++counts[(source[k] >> shift) & 0xff];
+        });
+
+        uint32_t offset = 0;
+        for (size_t digit = 0; digit < RADIX_BUCKETS; ++digit) {
+            for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+                uint32_t& slot = histograms[chunk * RADIX_BUCKETS + digit];
+                uint32_t digitCount = slot;
+                slot = offset;
+                offset += digitCount;
+            }
+        }
+
+        forEachChunk([&](size_t begin, size_t end) {
+            uint32_t* offsets = histograms.data() + begin / chunkSize * RADIX_BUCKETS;
+            for (size_t k = begin; k < end; ++k) {
+                uint64_t entry = source[k];
+                target[offsets[(entry >> shift) & 0xff]++] = entry;
+            }
+        });
+        std::swap(source, target);
+        ++passes;
+    }
+
+    if (source != entries.data())
+        entries.swap(scratch);
+    return passes;
+}
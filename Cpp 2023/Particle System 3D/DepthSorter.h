@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "ParticleKernels.h"
+
+class WorkerPool;
+
+struct DepthSortResult {
+    // Particles in the order.
+    size_t count;
+    // Started from last frame's order rather than from scratch.
+    bool reusedOrder;
+    // Reused last frame's order and every bucket was finished by insertion,
+    // so no bucket needed a radix sort of its own: a hit. reusedOrder
+    // without incremental is a miss.
+    bool incremental;
+    // Buckets of the reused order finished by insertion, and those that
+    // needed a radix sort.
+    size_t insertedBuckets;
+    size_t radixBuckets;
+    // Radix passes run over the whole list; a pass whose digit every key
+    // shares is skipped.
+    int radixPasses;
+
+    DepthSortResult()
+        : count(0), reusedOrder(false), incremental(false), insertedBuckets(0), radixBuckets(0), radixPasses(0) {}
+};
+
+// Puts particles in back-to-front draw order for alpha blending. Each
+// particle's key is its view-space z as a 32-bit integer that sorts like the
+// float, and the (key, index) pairs go through an LSD radix sort on 8-bit
+// digits, split across the worker pool when there is one.
+//
+// The sort is incremental. Unless the camera jumped, it starts from the
+// previous order, drops the particles that are no longer listed and appends
+// the new ones. One stable counting pass on the top 8 bits that vary
+// splits that list into buckets. Each bucket is still in last frame's
+// order, which smooth motion only disturbs locally, so an insertion pass
+// with a bounded number of moves finishes it. A bucket that runs out of
+// moves is radix sorted on its own, while it is in cache. Buckets are
+// finished in parallel on the pool. Both ways are timed as they run, and
+// while the scene moves so fast that reusing the order loses, the sorter
+// sorts from scratch and only retries the reuse now and then.
+class DepthSorter {
+public:
+    // Null sorts on the calling thread.
+    WorkerPool* workerPool;
+
+    DepthSorter();
+
+    // Orders the particles at indices, which must be live slots of
+    // particles, from the furthest to the nearest along the view direction.
+    // Positions are moved lookahead seconds along the velocity first, as the
+    // render vertices are.
+    DepthSortResult Sort(const ConstParticleSpan& particles, const uint32_t* indices, size_t count, float lookahead,
+        const glm::mat4& view);
+
+    // The slot indices of the last Sort(), furthest first.
+    const uint32_t* Order() const { return order.data(); }
+
+    // Forgets the previous order, so the next Sort() is a full one.
+    void Reset() { entries.clear(); }
+
+private:
+    // Key in the high half, slot index in the low half. Between sorts it
+    // holds the previous order.
+    std::vector<uint64_t> entries;
+    std::vector<uint64_t> scratch;
+    std::vector<uint32_t> order;
+    // Per slot: whether it is listed in the current Sort(), and whether it
+    // was carried over from the previous order, next to its key, so carrying
+    // the order over takes one read per particle.
+    struct SlotKey {
+        uint32_t mark;
+        uint32_t key;
+
+        SlotKey() : mark(0), key(0) {}
+    };
+    std::vector<SlotKey> slots;
+    uint32_t mark;
+    // 256 counts per chunk for the pass being run.
+    std::vector<uint32_t> histograms;
+    // Running nanoseconds per particle of reusing the previous order and of
+    // sorting from scratch; 0 until first timed.
+    double carriedCost;
+    double freshCost;
+    uint32_t sortsSinceTrial;
+
+    bool CarriedOrderSorted(size_t slotCount) const;
+    bool PreferCarriedOrder();
+    void RefineCarriedOrder(size_t count, uint32_t varyingBits, DepthSortResult& result);
+    int RadixSort(size_t count, uint32_t varyingBits);
+};
@@ -0,0 +1,47 @@
+#pragma once
+#include <cmath>
+
+// Turns variable frame times into a whole number of fixed simulation steps.
+// Leftover time carries over to the next frame, and Alpha() says how far the
+// simulation is between its last step and the next one, so rendering can run
+// at display rate while the simulation keeps its own.
+class FixedTimestep {
+public:
+    float step;
+    // Upper bound on steps per frame. When a frame takes longer than this
+    // many steps, the excess is dropped instead of making the next frame even
+    // slower (the "spiral of death").
+    int maxSubsteps;
+
+    FixedTimestep(float _step, int _maxSubsteps)
+        : step(_step), maxSubsteps(_maxSubsteps), accumulator(0.0f), droppedSteps(0) {}
+
+    // Adds the real time since the last frame and returns how many fixed
+    // steps to run now; zero when the display outpaces the simulation.
+    int Advance(float frameSeconds) {
+        accumulator += frameSeconds;
+        int substeps = static_cast<int>(accumulator / step);
+        if (substeps > maxSubsteps) {
+            droppedSteps += substeps - maxSubsteps;
+            substeps = maxSubsteps;
+        }
+        accumulator -= substeps * step;
+        if (accumulator >= step)
+            accumulator = std::fmod(accumulator, step);
+        return substeps;
+    }
+
+    // Fraction of a step accumulated but not yet simulated, in [0, 1).
+    float Alpha() const {
+        return accumulator / step;
+    }
+
+    // Steps skipped so far because a frame needed more than maxSubsteps.
+    long long DroppedSteps() const {
+        return droppedSteps;
+    }
+
+private:
+    float accumulator;
+    long long droppedSteps;
+};
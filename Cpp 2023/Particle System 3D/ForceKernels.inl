@@ -0,0 +1,324 @@
+// Force stages and the fused integration kernel, written once against an Ops
+// type and included by ParticleKernels.cpp inside one namespace per SIMD
+// level, each compiled for that level's instruction set. Ops provides Float,
+// WIDTH, Load, Store, Set, Zero, Add, Sub, Mul, Div, Sqrt, Sphere,
+// LoadSphere, Reflect and CountLanes, and for culling Min, GreaterEqualMask
+// and GreaterMask.
+
+struct Vector3 {
+    Ops::Float x, y, z;
+};
+
+// Each stage adds its acceleration to a; every stage sees the same p and v.
+
+struct GravityStage {
+    Ops::Float gravity;
+
+    explicit GravityStage(const ForceField& field) : gravity(Ops::Set(field.gravity)) {}
+
+    void Accumulate(const Vector3&, const Vector3&, Vector3& a) const {
+        a.y = Ops::Sub(a.y, gravity);
+    }
+};
+
+struct WindStage {
+    Vector3 wind;
+
+    explicit WindStage(const ForceField& field) {
+        wind.x = Ops::Set(field.wind.x);
+        wind.y = Ops::Set(field.wind.y);
+        wind.z = Ops::Set(field.wind.z);
+    }
+
+    void Accumulate(const Vector3&, const Vector3&, Vector3& a) const {
+        a.x = Ops::Add(a.x, wind.x);
+        a.y = Ops::Add(a.y, wind.y);
+        a.z = Ops::Add(a.z, wind.z);
+    }
+};
+
+struct DragStage {
+    Ops::Float drag;
+
+    explicit DragStage(const ForceField& field) : drag(Ops::Set(field.drag)) {}
+
+    void Accumulate(const Vector3&, const Vector3& v, Vector3& a) const {
+        a.x = Ops::Sub(a.x, Ops::Mul(v.x, drag));
+        a.y = Ops::Sub(a.y, Ops::Mul(v.y, drag));
+        a.z = Ops::Sub(a.z, Ops::Mul(v.z, drag));
+    }
+};
+
+// Tangential pull around the axis through the center, strongest near it and
+// falling off with the squared distance; the + 1 keeps the center finite.
+struct VortexStage {
+    Vector3 center;
+    Vector3 axis;
+    Ops::Float strength;
+    Ops::Float one;
+
+    explicit VortexStage(const ForceField& field) : strength(Ops::Set(field.vortexStrength)), one(Ops::Set(1.0f)) {
+        center.x = Ops::Set(field.vortexCenter.x);
+        center.y = Ops::Set(field.vortexCenter.y);
+        center.z = Ops::Set(field.vortexCenter.z);
+        axis.x = Ops::Set(field.vortexAxis.x);
+        axis.y = Ops::Set(field.vortexAxis.y);
+        axis.z = Ops::Set(field.vortexAxis.z);
+    }
+
+    void Accumulate(const Vector3& p, const Vector3&, Vector3& a) const {
+        Ops::Float dx = Ops::Sub(p.x, center.x);
+        Ops::Float dy = Ops::Sub(p.y, center.y);
+        Ops::Float dz = Ops::Sub(p.z, center.z);
+        Ops::Float distanceSquared = Ops::Add(Ops::Add(Ops::Mul(dx, dx), Ops::Mul(dy, dy)), Ops::Mul(dz, dz));
+        Ops::Float scale = Ops::Div(strength, Ops::Add(distanceSquared, one));
+        a.x = Ops::Add(a.x, Ops::Mul(Ops::Sub(Ops::Mul(axis.y, dz), Ops::Mul(axis.z, dy)), scale));
+        a.y = Ops::Add(a.y, Ops::Mul(Ops::Sub(Ops::Mul(axis.z, dx), Ops::Mul(axis.x, dz)), scale));
+        a.z = Ops::Add(a.z, Ops::Mul(Ops::Sub(Ops::Mul(axis.x, dy), Ops::Mul(axis.y, dx)), scale));
+    }
+};
+
+// Inverse-square pull toward each attractor, softened so a particle passing
+// through one is not flung away.
+struct AttractorStage {
+    Vector3 position[MAX_ATTRACTORS];
+    Ops::Float strength[MAX_ATTRACTORS];
+    Ops::Float softening;
+    size_t count;
+
+    explicit AttractorStage(const ForceField& field)
+        : softening(Ops::Set(ATTRACTOR_SOFTENING)), count(field.attractorCount < MAX_ATTRACTORS ? field.attractorCount : MAX_ATTRACTORS) {
+        for (size_t k = 0; k < count; ++k) {
+            position[k].x = Ops::Set(field.attractors[k].position.x);
+            position[k].y = Ops::Set(field.attractors[k].position.y);
+            position[k].z = Ops::Set(field.attractors[k].position.z);
+            strength[k] = Ops::Set(field.attractors[k].strength);
+        }
+    }
+
+    void Accumulate(const Vector3& p, const Vector3&, Vector3& a) const {
+        for (size_t k = 0; k < count; ++k) {
+            Ops::Float dx = Ops::Sub(position[k].x, p.x);
+            Ops::Float dy = Ops::Sub(position[k].y, p.y);
+            Ops::Float dz = Ops::Sub(position[k].z, p.z);
+            Ops::Float distanceSquared = Ops::Add(Ops::Add(Ops::Add(Ops::Mul(dx, dx), Ops::Mul(dy, dy)),
+                Ops::Mul(dz, dz)), softening);
+            Ops::Float scale = Ops::Div(strength[k], Ops::Mul(distanceSquared, Ops::Sqrt(distanceSquared)));
+            a.x = Ops::Add(a.x, Ops::Mul(dx, scale));
+            a.y = Ops::Add(a.y, Ops::Mul(dy, scale));
+            a.z = Ops::Add(a.z, Ops::Mul(dz, scale));
+        }
+    }
+};
+
+// Stands in for a stage that is not in the mask.
+struct NoStage {
+    explicit NoStage(const ForceField&) {}
+
+    void Accumulate(const Vector3&, const Vector3&, Vector3&) const {}
+};
+
+template <unsigned Mask, unsigned Bit, typename Stage>
+using StageIf = typename std::conditional<(Mask & Bit) != 0, Stage, NoStage>::type;
+
+// The stages named by Mask, applied in one go. The others are NoStage, so
+// each combination compiles to its own straight-line loop body and sets up
+// nothing it does not use.
+template <unsigned Mask>
+struct ForcePipeline {
+    StageIf<Mask, FORCE_GRAVITY, GravityStage> gravity;
+    StageIf<Mask, FORCE_WIND, WindStage> wind;
+    StageIf<Mask, FORCE_DRAG, DragStage> drag;
+    StageIf<Mask, FORCE_VORTEX, VortexStage> vortex;
+    StageIf<Mask, FORCE_ATTRACTORS, AttractorStage> attractors;
+
+    explicit ForcePipeline(const ForceField& field)
+        : gravity(field), wind(field), drag(field), vortex(field), attractors(field) {}
+
+    void Accumulate(const Vector3& p, const Vector3& v, Vector3& a) const {
+        gravity.Accumulate(p, v, a);
+        wind.Accumulate(p, v, a);
+        drag.Accumulate(p, v, a);
+        vortex.Accumulate(p, v, a);
+        attractors.Accumulate(p, v, a);
+    }
+};
+
+// x + y * scale, per component.
+inline Vector3 AddScaled(const Vector3& x, const Vector3& y, Ops::Float scale) {
+    Vector3 sum = { Ops::Add(x.x, Ops::Mul(y.x, scale)), Ops::Add(x.y, Ops::Mul(y.y, scale)),
+        Ops::Add(x.z, Ops::Mul(y.z, scale)) };
+    return sum;
+}
+
+// v + a * scale for an acceleration from ForcePipeline<Mask>. Gravity alone
+// only ever pulls along y, so x and z are left alone then, and with no
+// forces at all v is returned as it is.
+template <unsigned Mask>
+Vector3 Accelerate(const Vector3& v, const Vector3& a, Ops::Float scale) {
+    if constexpr (Mask == 0)
+        return v;
+    else if constexpr (Mask == FORCE_GRAVITY) {
+        Vector3 result = { v.x, Ops::Add(v.y, Ops::Mul(a.y, scale)), v.z };
+        return result;
+    }
+    else
+        return AddScaled(v, a, scale);
+}
+
+template <unsigned Mask>
+Vector3 Acceleration(const ForcePipeline<Mask>& forces, const Vector3& p, const Vector3& v) {
+    Vector3 a = { Ops::Zero(), Ops::Zero(), Ops::Zero() };
+    forces.Accumulate(p, v, a);
+    return a;
+}
+
+// The integration schemes, as policies of IntegrateForces. Each advances p
+// and v by one step of dt.
+template <Integrator Scheme>
+struct IntegrationScheme;
+
+template <>
+struct IntegrationScheme<Integrator::Euler> {
+    template <unsigned Mask>
+    static void Step(const ForcePipeline<Mask>& forces, Vector3& p, Vector3& v, Ops::Float dt, Ops::Float) {
+        p = AddScaled(p, v, dt);
+        v = Accelerate<Mask>(v, Acceleration(forces, p, v), dt);
+    }
+};
+
+template <>
+struct IntegrationScheme<Integrator::SemiImplicitEuler> {
+    template <unsigned Mask>
+    static void Step(const ForcePipeline<Mask>& forces, Vector3& p, Vector3& v, Ops::Float dt, Ops::Float) {
+        v = Accelerate<Mask>(v, Acceleration(forces, p, v), dt);
+        p = AddScaled(p, v, dt);
+    }
+};
+
+// Velocity Verlet. Drag depends on velocity, so the acceleration at the end
+// of the step is taken at the velocity Euler predicts for it.
+template <>
+struct IntegrationScheme<Integrator::Verlet> {
+    template <unsigned Mask>
+    static void Step(const ForcePipeline<Mask>& forces, Vector3& p, Vector3& v, Ops::Float dt, Ops::Float halfDt) {
+        Vector3 a = Acceleration(forces, p, v);
+        Vector3 halfStep = Accelerate<Mask>(v, a, halfDt);
+        p = AddScaled(p, halfStep, dt);
+        Vector3 end = Acceleration(forces, p, Accelerate<Mask>(v, a, dt));
+        v = Accelerate<Mask>(halfStep, end, halfDt);
+    }
+};
+
+// The midpoint method: the whole step uses the velocity and acceleration
+// half a step in.
+template <>
+struct IntegrationScheme<Integrator::RK2> {
+    template <unsigned Mask>
+    static void Step(const ForcePipeline<Mask>& forces, Vector3& p, Vector3& v, Ops::Float dt, Ops::Float halfDt) {
+        Vector3 midVelocity = Accelerate<Mask>(v, Acceleration(forces, p, v), halfDt);
+        Vector3 midAcceleration = Acceleration(forces, AddScaled(p, v, halfDt), midVelocity);
+        p = AddScaled(p, midVelocity, dt);
+        v = Accelerate<Mask>(v, midAcceleration, dt);
+    }
+};
+
+// Ages particles [begin, span.count), advances them one step under the
+// forces with the given scheme and reflects the ones still alive off the
+// sphere, in a single pass. Velocity components nothing changed are not
+// written back.
+template <Integrator Scheme, unsigned Mask>
+size_t IntegrateForces(const ParticleSpan& columns, size_t begin, const IntegrateParams& params,
+    const SphereCollider* sphere) {
+    // A local copy, so the column pointers stay in registers rather than
+    // being reloaded after every store.
+    const ParticleSpan span = columns;
+    const Ops::Float deltaTime = Ops::Set(params.deltaTime);
+    const Ops::Float halfDeltaTime = Ops::Set(params.deltaTime * 0.5f);
+    const Ops::Float lifeDecay = Ops::Set(params.lifeDecay);
+    const ForcePipeline<Mask> forces(*params.forces);
+    const Ops::Sphere collider = Ops::LoadSphere(sphere != nullptr ? *sphere : SphereCollider());
+    constexpr bool lateral = (Mask & ~FORCE_GRAVITY) != 0;
+
+    size_t collisions = 0;
+    size_t i = begin;
+    for (; i + Ops::WIDTH <= span.count; i += Ops::WIDTH) {
+        Ops::Float life = Ops::Sub(Ops::Load(span.life + i), lifeDecay);
+        Ops::Store(span.life + i, life);
+
+        Vector3 p = { Ops::Load(span.positionX + i), Ops::Load(span.positionY + i), Ops::Load(span.positionZ + i) };
+        Vector3 v = { Ops::Load(span.velocityX + i), Ops::Load(span.velocityY + i), Ops::Load(span.velocityZ + i) };
+        IntegrationScheme<Scheme>::Step(forces, p, v, deltaTime, halfDeltaTime);
+        Ops::Store(span.positionX + i, p.x);
+        Ops::Store(span.positionY + i, p.y);
+        Ops::Store(span.positionZ + i, p.z);
+
+        int reflected = sphere != nullptr ? Ops::Reflect(collider, life, p.x, p.y, p.z, v.x, v.y, v.z) : 0;
+        if (reflected != 0)
+            collisions += Ops::CountLanes(reflected);
+        if (lateral || reflected != 0) {
+            Ops::Store(span.velocityX + i, v.x);
+            Ops::Store(span.velocityZ + i, v.z);
+        }
+        if (Mask != 0 || reflected != 0)
+            Ops::Store(span.velocityY + i, v.y);
+    }
+
+    if constexpr (Ops::WIDTH > 1)
+        collisions += scalar::IntegrateForces<Scheme, Mask>(span, i, params, sphere);
+    return collisions;
+}
+
+typedef size_t (*IntegrateFunction)(const ParticleSpan& span, size_t begin, const IntegrateParams& params,
+    const SphereCollider* sphere);
+
+// IntegrateForces for every scheme and mask, indexed by
+// scheme * FORCE_MASK_COUNT + mask.
+template <size_t... Kernels>
+const IntegrateFunction* IntegrateTable(std::index_sequence<Kernels...>) {
+    static const IntegrateFunction table[] = {
+        &IntegrateForces<static_cast<Integrator>(Kernels / FORCE_MASK_COUNT), static_cast<unsigned>(Kernels % FORCE_MASK_COUNT)>...
+    };
+    return table;
+}
+
+inline IntegrateFunction SelectIntegrate(Integrator scheme, unsigned mask) {
+    return IntegrateTable(std::make_index_sequence<INTEGRATOR_COUNT * FORCE_MASK_COUNT>())[
+        static_cast<size_t>(scheme) * FORCE_MASK_COUNT + mask];
+}
+
+// A single stage as a pass of its own over particles [begin, span.count),
+// reading and writing the columns once per stage. This is what the fused
+// pipeline saves; ApplyForces() keeps it around to be measured against.
+template <unsigned Stage>
+void ApplyStage(const ParticleSpan& columns, size_t begin, const IntegrateParams& params) {
+    const ParticleSpan span = columns;
+    const Ops::Float deltaTime = Ops::Set(params.deltaTime);
+    const ForcePipeline<Stage> forces(*params.forces);
+
+    size_t i = begin;
+    for (; i + Ops::WIDTH <= span.count; i += Ops::WIDTH) {
+        Vector3 p = { Ops::Load(span.positionX + i), Ops::Load(span.positionY + i), Ops::Load(span.positionZ + i) };
+        Vector3 v = { Ops::Load(span.velocityX + i), Ops::Load(span.velocityY + i), Ops::Load(span.velocityZ + i) };
+        Vector3 a = Acceleration(forces, p, v);
+        Ops::Store(span.velocityX + i, Ops::Add(v.x, Ops::Mul(a.x, deltaTime)));
+        Ops::Store(span.velocityY + i, Ops::Add(v.y, Ops::Mul(a.y, deltaTime)));
+        Ops::Store(span.velocityZ + i, Ops::Add(v.z, Ops::Mul(a.z, deltaTime)));
+    }
+
+    if constexpr (Ops::WIDTH > 1)
+        scalar::ApplyStage<Stage>(span, i, params);
+}
+
+typedef void (*ApplyFunction)(const ParticleSpan& span, size_t begin, const IntegrateParams& params);
+
+// ApplyStage for every stage, indexed by the stage's bit position.
+template <size_t... Stages>
+const ApplyFunction* ApplyTable(std::index_sequence<Stages...>) {
+    static const ApplyFunction table[] = { &ApplyStage<1u << Stages>... };
+    return table;
+}
+
+inline ApplyFunction SelectApply(size_t stage) {
+    return ApplyTable(std::make_index_sequence<FORCE_STAGE_COUNT>())[stage];
+}
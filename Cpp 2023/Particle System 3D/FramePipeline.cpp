@@ -0,0 +1,99 @@
+#include "FramePipeline.h"
+
+namespace {
+    // Slots per integration or packing chunk: small enough to balance the
+    // threads at a few thousand particles, a whole number of cache lines of
+    // every column.
+    const size_t PIPELINE_CHUNK_SIZE = 4096;
+}
+
+FramePipeline::FramePipeline(JobScheduler& _scheduler, ParticleRenderer& _renderer)
+    : overlap(true), scheduler(_scheduler), renderer(_renderer), emitter(nullptr), generator(nullptr),
+      system(nullptr), stepSeconds(0.0f), stepsLeft(0), startedSteps(0), finishedSteps(0), view(1.0f),
+      projection(1.0f), alpha(0.0f) {}
+
+void FramePipeline::SetEmitter(ParticleEmitter* _emitter, ParticleGenerator* _generator) {
+    emitter = _emitter;
+    generator = _generator;
+    // A fixed pool's capacity, so publishing stays off the heap as well.
+    published.Reserve(emitter->particles.life.capacity());
+
+    JobGraph::JobId emit = stepGraph.Add("emit", [this] {
+        if (generator != nullptr)
+            generator->Update(stepSeconds);
+        emitter->BeginStep(stepSeconds);
+    });
+    JobGraph::JobId integrate = stepGraph.AddParallel("integrate", [this] { return emitter->StepSlots(); },
+        PIPELINE_CHUNK_SIZE, [this](size_t begin, size_t end) { emitter->IntegrateRange(begin, end); });
+    JobGraph::JobId collide = stepGraph.Add("collide", [this] { emitter->CollideStep(); });
+    JobGraph::JobId compact = stepGraph.Add("compact", [this] { emitter->CompactStep(); });
+    stepGraph.Precede(emit, integrate);
+    stepGraph.Precede(integrate, collide);
+    stepGraph.Precede(collide, compact);
+
+    BuildGraphs(compact);
+}
+
+void FramePipeline::SetSystem(ParticleSystem* _system) {
+    system = _system;
+    // Every emitter's segment is already carved out, so this is the most
+    // the system ever holds.
+    published.Reserve(system->particles.Size());
+    BuildGraphs(stepGraph.Add("step system", [this] { system->Update(stepSeconds); }));
+}
+
+// The copy costs a pass over every column, so only the state a frame can
+// show is published.
+void FramePipeline::BuildGraphs(JobGraph::JobId lastStepJob) {
+    JobGraph::JobId publish = stepGraph.Add("publish", [this] {
+        ++finishedSteps;
+        if (--stepsLeft == 0)
+            published.Publish(Particles(), finishedSteps);
+    });
+    stepGraph.Precede(lastStepJob, publish);
+
+    // Whichever state is acquired, it is moved ahead by the steps it is
+    // behind, so the drawn moment does not depend on how far they got.
+    JobGraph::JobId cull = renderGraph.Add("cull and sort", [this] {
+        const ParticleStorage& particles = published.Acquire();
+        float behind = static_cast<float>(startedSteps - published.AcquiredStamp());
+        renderer.Prepare(particles, view, projection, (behind + alpha) * stepSeconds);
+    });
+    JobGraph::JobId map = renderGraph.Add("map", [this] { renderer.Map(); }, JobAffinity::Main);
+    JobGraph::JobId pack = renderGraph.AddParallel("pack", [this] { return renderer.PackCount(); },
+        PIPELINE_CHUNK_SIZE, [this](size_t begin, size_t end) { renderer.PackRange(begin, end); });
+    renderGraph.Precede(cull, map);
+    renderGraph.Precede(map, pack);
+}
+
+void FramePipeline::Prepare(const glm::mat4& _view, const glm::mat4& _projection, float _alpha) {
+    view = _view;
+    projection = _projection;
+    alpha = _alpha;
+    scheduler.Submit(renderGraph);
+    scheduler.Wait(renderGraph);
+}
+
+void FramePipeline::Simulate(int steps, float step) {
+    // No steps run between Finish() and here, so this is safe to set.
+    stepSeconds = step;
+    if (steps <= 0)
+        return;
+    stepsLeft = steps;
+    startedSteps += static_cast<uint64_t>(steps);
+    scheduler.Submit(stepGraph, static_cast<size_t>(steps));
+    if (!overlap)
+        scheduler.Wait(stepGraph);
+}
+
+void FramePipeline::Draw(const glm::mat4& _view, const glm::mat4& _projection) {
+    renderer.Draw(_view, _projection);
+}
+
+void FramePipeline::Finish() {
+    scheduler.Wait(stepGraph);
+}
+
+void FramePipeline::Publish() {
+    published.Publish(Particles(), finishedSteps);
+}
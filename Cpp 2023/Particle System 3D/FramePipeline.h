@@ -0,0 +1,83 @@
+#pragma once
+#include <glm/glm.hpp>
+#include "JobScheduler.h"
+#include "ParticleEmitter.h"
+#include "ParticleGenerator.h"
+#include "ParticleRenderer.h"
+#include "ParticleStateBuffer.h"
+#include "ParticleSystem.h"
+
+// The frame's particle work as two job graphs on a JobScheduler.
+//
+// The step graph runs one fixed step, emit -> integrate -> collide ->
+// compact, with the integration split across the threads, and is repeated
+// once per substep; after the last one it publishes the particles to a
+// ParticleStateBuffer. The render graph gets the vertices ready from the
+// newest published state, cull and sort -> map -> pack, with the packing
+// split across the threads and the map on the main thread, which owns the
+// GL context.
+//
+// A frame calls Finish(), Simulate(), Prepare() and Draw() in that order.
+// The render graph never reads the simulated storage, so the steps run on
+// the workers through the whole frame. The frame shows the newest state
+// published by then, which is this frame's steps when they already finished
+// and the previous frame's otherwise; every state is published with the
+// number of steps behind it, so either way it is moved ahead to the same
+// moment. Nothing but the graphs may touch the particles between
+// Simulate() and Finish().
+class FramePipeline {
+public:
+    // When false, Simulate() waits for its steps, as a serial loop would.
+    bool overlap;
+
+    FramePipeline(JobScheduler& _scheduler, ParticleRenderer& _renderer);
+
+    FramePipeline(const FramePipeline&) = delete;
+    FramePipeline& operator=(const FramePipeline&) = delete;
+
+    // Steps one emitter, fed by generator before each step.
+    void SetEmitter(ParticleEmitter* emitter, ParticleGenerator* generator);
+    // Steps a whole ParticleSystem as a single job; it splits its own work
+    // across its worker pool. Add every emitter first.
+    void SetSystem(ParticleSystem* system);
+
+    // Starts steps fixed steps of step seconds and returns at once.
+    void Simulate(int steps, float step);
+    // Culls, sorts and packs the newest published particles, moved ahead to
+    // alpha steps past the end of the steps Simulate() started.
+    void Prepare(const glm::mat4& view, const glm::mat4& projection, float alpha);
+    // Uploads and draws what Prepare() packed.
+    void Draw(const glm::mat4& view, const glm::mat4& projection);
+    // Waits for the steps Simulate() started.
+    void Finish();
+    // Publishes the particles as they are, for changes made outside the
+    // steps such as restoring a snapshot. Call after Finish().
+    void Publish();
+
+    const JobGraph& StepGraph() const { return stepGraph; }
+    const JobGraph& RenderGraph() const { return renderGraph; }
+    const ParticleStateBuffer& PublishedState() const { return published; }
+
+private:
+    JobScheduler& scheduler;
+    ParticleRenderer& renderer;
+    ParticleEmitter* emitter;
+    ParticleGenerator* generator;
+    ParticleSystem* system;
+    JobGraph stepGraph;
+    JobGraph renderGraph;
+    ParticleStateBuffer published;
+    // Read by the jobs of the current run.
+    float stepSeconds;
+    int stepsLeft;
+    // Steps started by Simulate() and steps finished, the latter stamped on
+    // every published state.
+    uint64_t startedSteps;
+    uint64_t finishedSteps;
+    glm::mat4 view;
+    glm::mat4 projection;
+    float alpha;
+
+    const ParticleStorage& Particles() const { return system != nullptr ? system->particles : emitter->particles; }
+    void BuildGraphs(JobGraph::JobId lastStepJob);
+};
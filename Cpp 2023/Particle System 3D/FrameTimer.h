@@ -0,0 +1,28 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include "ParticleStats.h"
+
+// Measures the time between consecutive Tick() calls and hands each frame
+// time to stats, which reports it with the rest of its samples.
+class FrameTimer {
+public:
+    ParticleStats* stats;
+
+    explicit FrameTimer(ParticleStats* _stats = nullptr) : stats(_stats), started(false) {}
+
+    void Tick() {
+        Clock::time_point now = Clock::now();
+        if (started && stats != nullptr)
+            stats->AddFrameTime(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(now - lastTick).count()));
+        started = true;
+        lastTick = now;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    bool started;
+    Clock::time_point lastTick;
+};
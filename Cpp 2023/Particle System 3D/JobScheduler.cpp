@@ -0,0 +1,228 @@
+#include "JobScheduler.h"
+#include <algorithm>
+
+JobGraph::JobGraph() : jobsLeft(0), runsLeft(0) {}
+
+JobGraph::JobId JobGraph::AddNode(const char* name, std::function<void(size_t, size_t)> run,
+    std::function<size_t()> count, size_t chunkSize, JobAffinity affinity) {
+    std::unique_ptr<Node> node(new Node());
+    node->name = name;
+    node->run = std::move(run);
+    node->count = std::move(count);
+    node->chunkSize = chunkSize > 0 ? chunkSize : 1;
+    node->affinity = affinity;
+    node->predecessorCount = 0;
+    node->waitingFor.store(0, std::memory_order_relaxed);
+    node->chunksLeft.store(0, std::memory_order_relaxed);
+    nodes.push_back(std::move(node));
+    return nodes.size() - 1;
+}
+
+void JobGraph::Precede(JobId before, JobId after) {
+    nodes[before]->successors.push_back(after);
+    ++nodes[after]->predecessorCount;
+}
+
+bool JobScheduler::ChunkQueue::PushBack(const Chunk& chunk) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (size == QUEUE_CAPACITY)
+        return false;
+    chunks[(front + size) % QUEUE_CAPACITY] = chunk;
+    ++size;
+    return true;
+}
+
+bool JobScheduler::ChunkQueue::PopBack(Chunk& chunk) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (size == 0)
+        return false;
+    --size;
+    chunk = chunks[(front + size) % QUEUE_CAPACITY];
+    return true;
+}
+
+bool JobScheduler::ChunkQueue::PopFront(Chunk& chunk) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (size == 0)
+        return false;
+    chunk = chunks[front];
+    front = (front + 1) % QUEUE_CAPACITY;
+    --size;
+    return true;
+}
+
+JobScheduler::JobScheduler(size_t threadCount)
+    : queuedChunks(0), mainQueuedChunks(0), steals(0), stopping(false) {
+    if (threadCount == 0)
+        threadCount = std::thread::hardware_concurrency();
+    if (threadCount == 0)
+        threadCount = 1;
+
+    // Queue 0 belongs to the main thread.
+    for (size_t i = 0; i < threadCount; ++i)
+        queues.emplace_back(new ChunkQueue());
+    workers.reserve(threadCount - 1);
+    for (size_t i = 1; i < threadCount; ++i)
+        workers.emplace_back(&JobScheduler::WorkerLoop, this, i);
+}
+
+JobScheduler::~JobScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+void JobScheduler::Submit(JobGraph& graph, size_t runs) {
+    if (runs == 0 || graph.nodes.empty())
+        return;
+    graph.runsLeft.store(runs, std::memory_order_release);
+    StartRun(graph, 0);
+}
+
+void JobScheduler::Wait(JobGraph& graph) {
+    Chunk chunk;
+    while (!graph.Finished()) {
+        if (Take(0, true, chunk)) {
+            Execute(chunk, 0);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [&] {
+            return graph.Finished() || queuedChunks.load(std::memory_order_acquire) > 0
+                || mainQueuedChunks.load(std::memory_order_acquire) > 0;
+        });
+    }
+}
+
+// Every waiting count is reset before the first root is queued, and queueing
+// takes a lock, so a root that finishes at once sees the counts of this run.
+void JobScheduler::StartRun(JobGraph& graph, size_t queue) {
+    graph.jobsLeft.store(graph.nodes.size(), std::memory_order_relaxed);
+    graph.roots.clear();
+    for (size_t i = 0; i < graph.nodes.size(); ++i) {
+        JobGraph::Node& node = *graph.nodes[i];
+        node.waitingFor.store(node.predecessorCount, std::memory_order_relaxed);
+        if (node.predecessorCount == 0)
+            graph.roots.push_back(i);
+    }
+    for (JobGraph::JobId root : graph.roots)
+        MakeReady(graph, *graph.nodes[root], queue);
+}
+
+void JobScheduler::MakeReady(JobGraph& graph, JobGraph::Node& node, size_t queue) {
+    size_t count = node.count ? node.count() : 1;
+    size_t chunkCount = node.count ? (count + node.chunkSize - 1) / node.chunkSize : 1;
+    if (chunkCount == 0) {
+        FinishJob(graph, node, queue);
+        return;
+    }
+
+    node.chunksLeft.store(chunkCount, std::memory_order_relaxed);
+    for (size_t c = 0; c < chunkCount; ++c) {
+        Chunk chunk;
+        chunk.graph = &graph;
+        chunk.node = &node;
+        chunk.begin = c * node.chunkSize;
+        chunk.end = std::min(count, chunk.begin + node.chunkSize);
+        Push(chunk, queue);
+    }
+    Notify();
+}
+
+// Counted before the chunk becomes visible, so a thief that takes it at once
+// never drives the count below zero. A full queue runs the chunk right away
+// instead. Main chunks may only run on the main thread, queue 0, so when the
+// main queue is full the main thread runs them itself and other threads
+// wait for it to make room, which it does in Wait().
+void JobScheduler::Push(const Chunk& chunk, size_t queue) {
+    if (chunk.node->affinity == JobAffinity::Main) {
+        mainQueuedChunks.fetch_add(1, std::memory_order_release);
+        while (!mainQueue.PushBack(chunk)) {
+            if (queue == 0) {
+                mainQueuedChunks.fetch_sub(1, std::memory_order_relaxed);
+                Execute(chunk, queue);
+                return;
+            }
+            std::this_thread::yield();
+        }
+        return;
+    }
+    queuedChunks.fetch_add(1, std::memory_order_release);
+    if (!queues[queue]->PushBack(chunk)) {
+        queuedChunks.fetch_sub(1, std::memory_order_relaxed);
+        Execute(chunk, queue);
+    }
+}
+
+// Main chunks first, then the newest of the thread's own, then the oldest
+// of another thread's, trying the neighbours in turn.
+bool JobScheduler::Take(size_t queue, bool main, Chunk& chunk) {
+    if (main && mainQueue.PopFront(chunk)) {
+        mainQueuedChunks.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+    if (queues[queue]->PopBack(chunk)) {
+        queuedChunks.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+    for (size_t i = 1; i < queues.size(); ++i) {
+        if (queues[(queue + i) % queues.size()]->PopFront(chunk)) {
+            queuedChunks.fetch_sub(1, std::memory_order_relaxed);
+            steals.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobScheduler::Execute(const Chunk& chunk, size_t queue) {
+    chunk.node->run(chunk.begin, chunk.end);
+    if (chunk.node->chunksLeft.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        FinishJob(*chunk.graph, *chunk.node, queue);
+}
+
+// Successors are queued on the thread that finished their last dependency.
+// The last job of a run starts the next one or marks the graph finished.
+void JobScheduler::FinishJob(JobGraph& graph, JobGraph::Node& node, size_t queue) {
+    for (JobGraph::JobId successor : node.successors) {
+        JobGraph::Node& next = *graph.nodes[successor];
+        if (next.waitingFor.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            MakeReady(graph, next, queue);
+    }
+    if (graph.jobsLeft.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+    if (graph.runsLeft.load(std::memory_order_relaxed) > 1) {
+        graph.runsLeft.fetch_sub(1, std::memory_order_relaxed);
+        StartRun(graph, queue);
+        return;
+    }
+    graph.runsLeft.store(0, std::memory_order_release);
+    Notify();
+}
+
+// Sleepers check their condition under sleepMutex, so taking it before
+// notifying means none of them can miss the change.
+void JobScheduler::Notify() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wake.notify_all();
+}
+
+void JobScheduler::WorkerLoop(size_t queue) {
+    Chunk chunk;
+    for (;;) {
+        if (Take(queue, false, chunk)) {
+            Execute(chunk, queue);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [&] { return stopping || queuedChunks.load(std::memory_order_acquire) > 0; });
+        if (stopping)
+            return;
+    }
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Which threads may run a job.
+enum class JobAffinity {
+    // Any thread of the scheduler, including the one in Wait().
+    Any,
+    // Only the thread in Wait(), for work such as GL calls that is tied to
+    // it.
+    Main
+};
+
+// Jobs and the dependencies between them, built once and run as a whole
+// each time it is submitted. A job starts when every job it depends on has
+// finished; a parallel job is split into chunks that any thread may take.
+// The jobs are stored as std::function, so building the graph allocates
+// but running it does not.
+class JobGraph {
+public:
+    using JobId = size_t;
+
+    JobGraph();
+
+    JobGraph(const JobGraph&) = delete;
+    JobGraph& operator=(const JobGraph&) = delete;
+
+    // Calls job() once per run.
+    template <typename Job>
+    JobId Add(const char* name, Job job, JobAffinity affinity = JobAffinity::Any) {
+        return AddNode(name, [job](size_t, size_t) { job(); }, nullptr, 1, affinity);
+    }
+
+    // Calls job(begin, end) for every chunkSize-long piece of [0, count()),
+    // where count() is asked when the job becomes ready, so it can depend on
+    // the jobs before it.
+    template <typename Count, typename Job>
+    JobId AddParallel(const char* name, Count count, size_t chunkSize, Job job) {
+        return AddNode(name, job, count, chunkSize, JobAffinity::Any);
+    }
+
+    // after starts only once before has finished.
+    void Precede(JobId before, JobId after);
+
+    size_t JobCount() const { return nodes.size(); }
+    const char* JobName(JobId job) const { return nodes[job]->name; }
+    // Whether the last submitted run, with all its repetitions, is over.
+    bool Finished() const { return runsLeft.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class JobScheduler;
+
+    struct Node {
+        const char* name;
+        std::function<void(size_t, size_t)> run;
+        // Null for a job that runs once per run.
+        std::function<size_t()> count;
+        size_t chunkSize;
+        JobAffinity affinity;
+        std::vector<JobId> successors;
+        size_t predecessorCount;
+        // Jobs before this one that have not finished in the current run.
+        std::atomic<size_t> waitingFor;
+        std::atomic<size_t> chunksLeft;
+    };
+
+    std::vector<std::unique_ptr<Node>> nodes;
+    std::vector<JobId> roots;
+    // Jobs of the current run that have not finished.
+    std::atomic<size_t> jobsLeft;
+    // Runs still to go, counting the current one.
+    std::atomic<size_t> runsLeft;
+
+    JobId AddNode(const char* name, std::function<void(size_t, size_t)> run, std::function<size_t()> count,
+        size_t chunkSize, JobAffinity affinity);
+};
+
+// Runs job graphs on a fixed set of threads that steal work from each other.
+// Each thread has its own queue: it takes the newest chunk from its own
+// queue, so a job's successors run while its data is still in cache, and
+// when that is empty takes the oldest chunk from another thread's queue.
+// The thread calling Submit() and Wait() takes part as the main thread, so
+// a scheduler of N threads spawns N - 1 workers. Submit() and Wait() must
+// always come from that one thread.
+class JobScheduler {
+public:
+    // threadCount == 0 uses one thread per hardware core.
+    explicit JobScheduler(size_t threadCount = 0);
+    ~JobScheduler();
+
+    JobScheduler(const JobScheduler&) = delete;
+    JobScheduler& operator=(const JobScheduler&) = delete;
+
+    size_t ThreadCount() const { return queues.size(); }
+
+    // Starts runs back-to-back runs of graph and returns at once. A new run
+    // starts when the previous one has finished. The graph must not be
+    // submitted again before it finished.
+    void Submit(JobGraph& graph, size_t runs = 1);
+    // Runs chunks on the calling thread, Main jobs included, until graph has
+    // finished.
+    void Wait(JobGraph& graph);
+
+    // Chunks taken from another thread's queue so far.
+    uint64_t Steals() const { return steals.load(std::memory_order_relaxed); }
+
+private:
+    static const size_t QUEUE_CAPACITY = 1024;
+
+    struct Chunk {
+        JobGraph* graph;
+        JobGraph::Node* node;
+        size_t begin;
+        size_t end;
+    };
+
+    // Fixed ring of chunks behind a lock: the owner pushes and pops at the
+    // back, thieves pop at the front.
+    struct ChunkQueue {
+        std::mutex mutex;
+        Chunk chunks[QUEUE_CAPACITY];
+        size_t front;
+        size_t size;
+
+        ChunkQueue() : front(0), size(0) {}
+        bool PushBack(const Chunk& chunk);
+        bool PopBack(Chunk& chunk);
+        bool PopFront(Chunk& chunk);
+    };
+
+    std::vector<std::unique_ptr<ChunkQueue>> queues;
+    // Main jobs wait here for the thread in Wait().
+    ChunkQueue mainQueue;
+    std::vector<std::thread> workers;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    // Chunks any thread may take, so idle threads know when to look again.
+    std::atomic<size_t> queuedChunks;
+    std::atomic<size_t> mainQueuedChunks;
+    std::atomic<uint64_t> steals;
+    bool stopping;
+
+    void StartRun(JobGraph& graph, size_t queue);
+    void MakeReady(JobGraph& graph, JobGraph::Node& node, size_t queue);
+    void Push(const Chunk& chunk, size_t queue);
+    bool Take(size_t queue, bool main, Chunk& chunk);
+    void Execute(const Chunk& chunk, size_t queue);
+    void FinishJob(JobGraph& graph, JobGraph::Node& node, size_t queue);
+    void Notify();
+    void WorkerLoop(size_t queue);
+};
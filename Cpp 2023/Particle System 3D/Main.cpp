@@ -4,15 +4,41 @@
 #include <vector>
 #include <cstdlib>
 #include <ctime>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+#include <fstream>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/constants.hpp>
+#include "ParticleEmitter.h"
+#include "ParticleGenerator.h"
+#include "ParticleRenderer.h"
+#include "FrameTimer.h"
+#include "FixedTimestep.h"
+#include "ParticleStats.h"
+#include "SphereMeshCache.h"
+#include "ParticleRecorder.h"
+#include "ParticleSnapshot.h"
+#include "ParticleSystem.h"
+#include "WorkerPool.h"
+#include "JobScheduler.h"
+#include "FramePipeline.h"
+#include "ShaderManager.h"
 
 void processInput(GLFWwindow* window, glm::vec3& cameraPos, float& yaw, float& pitch);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
+void runRenderBenchmark(GLFWwindow* window, ParticleRenderer& renderer, ParticleEmitter& emitter,
+    const glm::mat4& projection, int frames);
 
 const float CAMERA_SPEED = 0.05f;
 const float MOUSE_SENSITIVITY = 0.1f;
+const float SIMULATION_STEP = 0.005f;
+const int MAX_SUBSTEPS = 8;
+const int MAX_PARTICLES = 5000;
+const double STATS_SAMPLE_INTERVAL = 1.0;
+const size_t RENDER_BENCH_PARTICLES = 200000;
 
 float lastX = 400.0f, lastY = 300.0f;
 bool firstMouse = true;
@@ -21,6 +47,10 @@ glm::vec3 cameraPos = glm::vec3(2.0f, 0.0f, 2.0f);
 glm::vec3 cameraFront = glm::vec3(1.0f, 0.0f, 0.0f);
 
 GLuint shaderProgram;
+// Looked up once after linking.
+GLint modelLocation = -1;
+GLint viewLocation = -1;
+GLint projectionLocation = -1;
 
 const char* vertexShaderSource = R"(
     #version 330 core
@@ -42,145 +72,126 @@ const char* fragmentShaderSource = R"(
     }
 )";
 
-class Particle {
-public:
-    glm::vec3 position;
-    glm::vec3 velocity;
-    glm::vec4 color;
-    float life;
+// Draws the cached sphere mesh; only the model matrix changes per frame.
+void renderSphere(SphereMeshCache& cache, float radius, int stacks, int sectors, const glm::vec3& position) {
+    const SphereMesh& mesh = cache.Get(radius, stacks, sectors);
 
-    Particle() : life(3.5f) {}
-};
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+    glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(model));
 
-class ParticleEmitter {
-public:
-    glm::vec3 position;
-    std::vector<Particle> particles;
-
-    void EmitParticle() {
-        Particle particle;
-        particle.position = position;
-        particle.velocity = glm::vec3((rand() % 100 - 50) / 100.0f, (rand() % 100 - 50) / 100.0f, (rand() % 100 - 50) / 100.0f);
-
-        particle.color = glm::vec4((rand() % 100) / 100.0f, (rand() % 100) / 100.0f, (rand() % 100) / 100.0f, 1.0f);
-
-        particles.push_back(particle);
-    }
-
-    void Update(float deltaTime) {
-        for (auto& particle : particles) {
-            particle.life -= deltaTime * 0.5f;
-            particle.position += particle.velocity * deltaTime;
-
-            particle.velocity.y -= 0.5f * deltaTime;
+    glBindVertexArray(mesh.vao);
+    glDrawArrays(GL_POINTS, 0, mesh.vertexCount);
+    glBindVertexArray(0);
+}
 
-            float sphereRadius = 0.5f;
-            glm::vec3 sphereCenter(0.0f, -1.0f, 0.0f);  
-            glm::vec3 particleToCenter = particle.position - sphereCenter;
-            float distanceToCenter = glm::length(particleToCenter);
-            if (distanceToCenter < sphereRadius) {
-                
-                particle.velocity = glm::reflect(particle.velocity, glm::normalize(particleToCenter));
-            }
+// Command line:
+//   --stats text|csv|binary   format of the stats dump (default text)
+//   --stats-file PATH         write stats to PATH instead of stdout
+//   --stats-interval SECONDS  how often to dump; 0 dumps only when F1 is pressed
+//   --vertex-format float|half  particle position precision on upload (default float)
+//   --render-mode points|billboards|blended  how particles are drawn (default billboards)
+//   --render-bench FRAMES     time both render modes over FRAMES frames and exit
+//   --seed N                  emission seed, for reproducible runs (default: clock)
+//   --record PATH             record the simulation workload for particle_bench --replay
+//   --emitters N              simulate N emitters on a ring in one ParticleSystem instead
+//                             of the single movable emitter (no recording or snapshots)
+//   --huge-pages 0|1          back the emitter's fixed particle pool with huge pages
+//   --snapshot PATH           where F5 saves and F9 restores the emitter (default particle_snapshot.bin)
+//   --cull 0|1                pack only particles inside the view frustum (default 1)
+//   --cull-distance D         also cull particles further than D along the view direction
+//   --depth-sort 0|1          draw billboards and blended points back to front (default 1)
+//   --overlap 0|1             simulate the next frame while this one is drawn (default 1)
+//   --shader-cache DIR        keep linked shader binaries in DIR, "" to disable (default shader_cache)
+int main(int argc, char** argv) {
+    StatsFormat statsFormat = StatsFormat::Text;
+    const char* statsPath = nullptr;
+    double statsInterval = 1.0;
+    RenderVertexFormat vertexFormat = RenderVertexFormat::Float3;
+    ParticleRenderMode renderMode = ParticleRenderMode::Billboards;
+    int renderBenchFrames = 0;
+    uint64_t seed = static_cast<uint64_t>(time(nullptr));
+    const char* recordPath = nullptr;
+    const char* snapshotPath = "particle_snapshot.bin";
+    int systemEmitters = 0;
+    bool hugePages = false;
+    bool culling = true;
+    float cullDistance = 0.0f;
+    bool depthSort = true;
+    bool overlap = true;
+    const char* shaderCacheDirectory = "shader_cache";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--stats") == 0) {
+            if (strcmp(argv[i + 1], "csv") == 0)
+                statsFormat = StatsFormat::Csv;
+            else if (strcmp(argv[i + 1], "binary") == 0)
+                statsFormat = StatsFormat::Binary;
+            else
+                statsFormat = StatsFormat::Text;
         }
-
-        particles.erase(std::remove_if(particles.begin(), particles.end(),
-            [](const Particle& p) { return p.life <= 0.0f; }), particles.end());
-    }
-
-    void Render() {
-        renderParticles();
-
-        std::cout << "Current number of particles: " << particles.size() << std::endl;
-    }
-
-private:
-    void renderParticles() {
-        GLuint vbo, vao;
-        glGenBuffers(1, &vbo);
-        glGenVertexArrays(1, &vao);
-
-        glBindVertexArray(vao);
-
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, particles.size() * sizeof(Particle), particles.data(), GL_DYNAMIC_DRAW);
-
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)offsetof(Particle, position));
-        glEnableVertexAttribArray(0);
-
-        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)offsetof(Particle, color));
-        glEnableVertexAttribArray(1);
-
-        glPointSize(5.0f);
-        glDrawArrays(GL_POINTS, 0, particles.size());
-
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-
-        glBindVertexArray(0);
-        glDeleteBuffers(1, &vbo);
-        glDeleteVertexArrays(1, &vao);
-    }
-};
-
-class ParticleGenerator {
-public:
-    ParticleEmitter* emitter;
-    float emitInterval;
-    float currentTime;
-    int maxParticles;
-
-    ParticleGenerator(ParticleEmitter* _emitter, float _emitInterval, int _maxParticles)
-        : emitter(_emitter), emitInterval(_emitInterval), currentTime(0.0f), maxParticles(_maxParticles) {}
-
-    void Update(float deltaTime) {
-        currentTime += deltaTime;
-        while (currentTime >= emitInterval && emitter->particles.size() < maxParticles) {
-            emitter->EmitParticle();
-            currentTime -= emitInterval;
+        else if (strcmp(argv[i], "--stats-file") == 0) {
+            statsPath = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "--stats-interval") == 0) {
+            statsInterval = atof(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "--vertex-format") == 0) {
+            vertexFormat = strcmp(argv[i + 1], "half") == 0 ? RenderVertexFormat::Half3 : RenderVertexFormat::Float3;
+        }
+        else if (strcmp(argv[i], "--render-mode") == 0) {
+            if (strcmp(argv[i + 1], "points") == 0)
+                renderMode = ParticleRenderMode::Points;
+            else if (strcmp(argv[i + 1], "blended") == 0)
+                renderMode = ParticleRenderMode::BlendedPoints;
+            else
+                renderMode = ParticleRenderMode::Billboards;
+        }
+        else if (strcmp(argv[i], "--render-bench") == 0) {
+            renderBenchFrames = atoi(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0) {
+            seed = strtoull(argv[i + 1], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--record") == 0) {
+            recordPath = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "--emitters") == 0) {
+            systemEmitters = atoi(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "--huge-pages") == 0) {
+            hugePages = atoi(argv[i + 1]) != 0;
+        }
+        else if (strcmp(argv[i], "--snapshot") == 0) {
+            snapshotPath = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "--cull") == 0) {
+            culling = atoi(argv[i + 1]) != 0;
+        }
+        else if (strcmp(argv[i], "--cull-distance") == 0) {
+            cullDistance = static_cast<float>(atof(argv[i + 1]));
+        }
+        else if (strcmp(argv[i], "--depth-sort") == 0) {
+            depthSort = atoi(argv[i + 1]) != 0;
+        }
+        else if (strcmp(argv[i], "--overlap") == 0) {
+            overlap = atoi(argv[i + 1]) != 0;
+        }
+        else if (strcmp(argv[i], "--shader-cache") == 0) {
+            shaderCacheDirectory = argv[i + 1];
         }
     }
-};
-
-void renderSphere(float radius, int stacks, int sectors, const glm::vec3& position) {
-    std::vector<glm::vec3> vertices;
-
-    for (int i = 0; i <= stacks; ++i) {
-        float stackAngle = glm::pi<float>() / 2 - i * glm::pi<float>() / stacks;
-        float xy = radius * glm::cos(stackAngle);
-        float z = radius * glm::sin(stackAngle);
-
-        for (int j = 0; j <= sectors; ++j) {
-            float sectorAngle = j * 2 * glm::pi<float>() / sectors;
-            float x = xy * glm::cos(sectorAngle);
-            float y = xy * glm::sin(sectorAngle);
-
-            vertices.push_back(glm::vec3(x, y, z) + position);
+    if (statsFormat == StatsFormat::Binary && statsPath == nullptr)
+        statsPath = "particle_stats.bin";
+
+    std::ofstream statsFile;
+    if (statsPath != nullptr) {
+        statsFile.open(statsPath, statsFormat == StatsFormat::Binary ? std::ios::binary : std::ios::out);
+        if (!statsFile) {
+            std::cout << "Couldn't open " << statsPath << std::endl;
+            return -1;
         }
     }
-
-    GLuint vbo, vao;
-    glGenBuffers(1, &vbo);
-    glGenVertexArrays(1, &vao);
-
-    glBindVertexArray(vao);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    glDrawArrays(GL_POINTS, 0, vertices.size());
-
-    glDisableVertexAttribArray(0);
-    glBindVertexArray(0);
-    glDeleteBuffers(1, &vbo);
-    glDeleteVertexArrays(1, &vao);
-}
-
-int main() {
-    srand(static_cast<unsigned int>(time(nullptr)));
+    std::ostream& statsOut = statsPath != nullptr ? statsFile : std::cout;
+    ParticleStats::WriteHeader(statsOut, statsFormat);
 
     GLFWwindow* window;
 
@@ -201,10 +212,34 @@ int main() {
 
     glEnable(GL_DEPTH_TEST); 
 
+    ParticleStats stats;
     ParticleEmitter emitter;
+    emitter.UseFixedPool(MAX_PARTICLES, hugePages);
+    emitter.stats = &stats;
+    emitter.Seed(seed);
+
+    ParticleRecorder recorder;
+    if (recordPath != nullptr) {
+        if (!recorder.Open(recordPath, emitter)) {
+            std::cout << "Couldn't open " << recordPath << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        emitter.recorder = &recorder;
+    }
     emitter.position = glm::vec3(0.0f, 0.0f, 0.0f);
 
-    ParticleGenerator generator(&emitter, 0.001f, 5000);
+    ParticleGenerator generator(&emitter, 0.001f, MAX_PARTICLES);
+
+    WorkerPool workerPool;
+    ParticleSystem system;
+    system.workerPool = &workerPool;
+    system.stats = &stats;
+    for (int i = 0; i < systemEmitters; ++i) {
+        float angle = glm::two_pi<float>() * static_cast<float>(i) / static_cast<float>(systemEmitters);
+        system.AddEmitter(glm::vec3(std::cos(angle), 0.5f, std::sin(angle)), 0.002f, 2000);
+    }
+    system.Seed(seed);
 
     glm::mat4 projection = glm::perspective(glm::radians(30.0f), 1200.0f / 1000.0f, 0.1f, 100.0f);
     glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f));
@@ -215,43 +250,134 @@ int main() {
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     glfwSetCursorPosCallback(window, mouse_callback);
 
-    GLuint vertexShader, fragmentShader;
-
-    vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-    glCompileShader(vertexShader);
-
-    fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fragmentShader);
+    ShaderManager shaders;
+    shaders.cacheDirectory = shaderCacheDirectory;
+    shaderProgram = shaders.Build("scene", vertexShaderSource, fragmentShaderSource);
+    if (shaderProgram == 0) {
+        glfwTerminate();
+        return -1;
+    }
+    modelLocation = shaders.UniformLocation(shaderProgram, "model");
+    viewLocation = shaders.UniformLocation(shaderProgram, "view");
+    projectionLocation = shaders.UniformLocation(shaderProgram, "projection");
+
+    glUseProgram(shaderProgram);
+
+    SphereMeshCache sphereMeshes;
+    ParticleRenderer particleRenderer;
+    particleRenderer.mode = renderMode;
+    particleRenderer.vertexFormat = vertexFormat;
+    particleRenderer.stats = &stats;
+    particleRenderer.culling = culling;
+    particleRenderer.cullDistance = cullDistance;
+    particleRenderer.depthSort = depthSort;
+    particleRenderer.workerPool = &workerPool;
+    particleRenderer.shaders = &shaders;
+    if (!particleRenderer.BuildPrograms()) {
+        glfwTerminate();
+        return -1;
+    }
+    shaders.ReportBuildTimes(std::cout);
 
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
+    if (renderBenchFrames > 0) {
+        runRenderBenchmark(window, particleRenderer, emitter, projection, renderBenchFrames);
+        particleRenderer.Destroy();
+        shaders.Destroy();
+        sphereMeshes.Destroy();
+        glfwTerminate();
+        return 0;
+    }
 
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+    JobScheduler scheduler;
+    FramePipeline pipeline(scheduler, particleRenderer);
+    pipeline.overlap = overlap;
+    if (systemEmitters > 0)
+        pipeline.SetSystem(&system);
+    else
+        pipeline.SetEmitter(&emitter, &generator);
+
+    FrameTimer frameTimer(&stats);
+    FixedTimestep timestep(SIMULATION_STEP, MAX_SUBSTEPS);
+    double lastFrameTime = glfwGetTime();
+    double lastSampleTime = lastFrameTime;
+    double lastDumpTime = lastFrameTime;
+    bool dumpKeyWasDown = false;
+    bool saveKeyWasDown = false;
+    bool loadKeyWasDown = false;
 
     while (!glfwWindowShouldClose(window)) {
+        frameTimer.Tick();
+        // The steps started last frame may still be running.
+        pipeline.Finish();
         processInput(window, emitter.position, yaw, pitch);
 
-        renderSphere(1.5f, 100, 100, glm::vec3(0.0f, -1.0f, 0.0f));
-        generator.Update(0.005f);
-        emitter.Update(0.005f);
+        double frameTime = glfwGetTime();
+        int substeps = timestep.Advance(static_cast<float>(frameTime - lastFrameTime));
+        lastFrameTime = frameTime;
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         glm::mat4 viewMatrix = glm::lookAt(cameraPos, cameraPos + glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(viewMatrix));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-
-        emitter.Render();
+        // The blended particle modes leave their program bound.
+        glUseProgram(shaderProgram);
+        glUniformMatrix4fv(viewLocation, 1, GL_FALSE, glm::value_ptr(viewMatrix));
+        glUniformMatrix4fv(projectionLocation, 1, GL_FALSE, glm::value_ptr(projection));
+
+        renderSphere(sphereMeshes, 1.5f, 100, 100, glm::vec3(0.0f, -1.0f, 0.0f));
+
+        // Particle positions are already in world space.
+        glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(glm::mat4(1.0f)));
+        // This frame's steps run while it is drawn from the newest published
+        // state, moved ahead to where they end plus the leftover fraction.
+        auto renderStart = std::chrono::steady_clock::now();
+        pipeline.Simulate(substeps, timestep.step);
+        pipeline.Prepare(viewMatrix, projection, timestep.Alpha());
+        pipeline.Draw(viewMatrix, projection);
+        stats.AddRenderTime(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - renderStart).count()));
+
+        if (frameTime - lastSampleTime >= STATS_SAMPLE_INTERVAL) {
+            stats.Sample();
+            lastSampleTime = frameTime;
+        }
+        bool dumpKeyDown = glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS;
+        if ((dumpKeyDown && !dumpKeyWasDown) || (statsInterval > 0.0 && frameTime - lastDumpTime >= statsInterval)) {
+            stats.Dump(statsOut, statsFormat);
+            lastDumpTime = frameTime;
+        }
+        dumpKeyWasDown = dumpKeyDown;
+
+        // A snapshot holds the single emitter, which --emitters mode does not
+        // draw, so F5 and F9 do nothing there.
+        bool saveKeyDown = systemEmitters == 0 && glfwGetKey(window, GLFW_KEY_F5) == GLFW_PRESS;
+        if (saveKeyDown && !saveKeyWasDown) {
+            pipeline.Finish();
+            if (!ParticleSnapshot::Save(snapshotPath, emitter))
+                std::cout << "Couldn't write " << snapshotPath << std::endl;
+        }
+        saveKeyWasDown = saveKeyDown;
+
+        bool loadKeyDown = systemEmitters == 0 && glfwGetKey(window, GLFW_KEY_F9) == GLFW_PRESS;
+        if (loadKeyDown && !loadKeyWasDown) {
+            pipeline.Finish();
+            ParticleSnapshot snapshot;
+            if (snapshot.Map(snapshotPath)) {
+                snapshot.Restore(emitter);
+                pipeline.Publish();
+            }
+            else
+                std::cout << "Couldn't read a snapshot from " << snapshotPath << std::endl;
+        }
+        loadKeyWasDown = loadKeyDown;
 
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
+    pipeline.Finish();
+    particleRenderer.Destroy();
+    shaders.Destroy();
+    sphereMeshes.Destroy();
     glfwTerminate();
 
     return 0;
@@ -318,4 +444,48 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
     if (pitch < -89.0f)
         pitch = -89.0f;
     
-}
\ No newline at end of file
+}
+
+// Spreads RENDER_BENCH_PARTICLES particles out for a second of simulated
+// time, then draws the same frame with each render mode, the blended ones
+// depth sorted unless --depth-sort 0. glFinish() makes the timing include
+// the GPU work, so with LIBGL_ALWAYS_SOFTWARE=1 this compares the paths
+// under llvmpipe.
+void runRenderBenchmark(GLFWwindow* window, ParticleRenderer& renderer, ParticleEmitter& emitter,
+    const glm::mat4& projection, int frames) {
+    // The app's pool only has room for MAX_PARTICLES.
+    emitter.UseFixedPool(RENDER_BENCH_PARTICLES);
+    emitter.EmitParticles(RENDER_BENCH_PARTICLES);
+    for (int step = 0; step < 200; ++step)
+        emitter.Update(SIMULATION_STEP);
+
+    // Looks straight at the emitter so the whole cloud is on screen.
+    glm::vec3 benchCameraPos = emitter.position + glm::vec3(0.0f, 0.0f, 3.0f);
+    glm::mat4 viewMatrix = glm::lookAt(benchCameraPos, emitter.position, glm::vec3(0.0f, 1.0f, 0.0f));
+    glUniformMatrix4fv(viewLocation, 1, GL_FALSE, glm::value_ptr(viewMatrix));
+    glUniformMatrix4fv(projectionLocation, 1, GL_FALSE, glm::value_ptr(projection));
+    glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(glm::mat4(1.0f)));
+
+    const ParticleRenderMode modes[] = { ParticleRenderMode::Points, ParticleRenderMode::Billboards,
+        ParticleRenderMode::BlendedPoints };
+    const char* modeNames[] = { "points", "billboards", "blended points" };
+    std::cout << "Renderer: " << glGetString(GL_RENDERER) << ", " << emitter.particles.LiveCount() << " particles" << std::endl;
+    for (int m = 0; m < 3; ++m) {
+        renderer.mode = modes[m];
+        double totalSeconds = 0.0;
+        // The first frames create buffers and shaders, so they are not timed.
+        for (int frame = -3; frame < frames; ++frame) {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            auto start = std::chrono::steady_clock::now();
+            renderer.Render(emitter, viewMatrix, projection);
+            glFinish();
+            if (frame >= 0)
+                totalSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+        std::cout << modeNames[m] << ": " << totalSeconds * 1000.0 / frames << " ms/frame, "
+            << renderer.LastCull().visible << " of " << renderer.LastCull().live << " particles drawn"
+            << (renderer.LastSort().count != 0 ? ", back to front" : "") << std::endl;
+    }
+}
@@ -0,0 +1,1581 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "ParticleEmitter.h"
+#include "ParticleGenerator.h"
+#include "WorkerPool.h"
+#include "RenderVertex.h"
+#include "Random.h"
+#include "ParticleRecorder.h"
+#include "ParticleSnapshot.h"
+#include "ParticleSystem.h"
+#include "DepthSorter.h"
+#include "JobScheduler.h"
+#include "ParticleStateBuffer.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Headless benchmark for the particle simulation. It links only the
+// simulation library, so it runs on machines without a GPU or a display.
+//
+//   particle_bench [--particles N] [--steps N] [--dt SECONDS] [--threads N]
+//                  [--simd scalar|sse2|avx2] [--seed N] [--record PATH]
+//                  [--replay PATH [--tolerance T]] [--snapshot PATH]
+//                  [--load-snapshot PATH] [--soak SECONDS [--huge-pages]] [--suite]
+//
+// Without --suite it simulates N particles for a number of fixed timesteps;
+// the generator tops the emitter back up as particles die. It ends with a
+// checksum of the final particle state, which is the same for every run
+// with the same seed, thread count and step settings. --record writes that
+// workload to PATH; --replay runs a recorded workload through the emitter as
+// configured by --simd and --threads and compares it with the recording,
+// exactly or, with --tolerance, on keyframes within T with every death,
+// collision and live count still exact. --snapshot saves the
+// final state to PATH; --load-snapshot maps a saved state, restores it and
+// prints its checksum, which matches the one printed when it was saved.
+// --soak keeps N particles churning in a fixed pool for SECONDS of wall time
+// and fails if the heap is touched once the population has turned over.
+// --suite runs the SIMD, threading, death-policy, collider, vertex-packing,
+// emission, replay, snapshot, multi-emitter, pool, force-pipeline,
+// integrator, culling, depth-sort, frame-graph and state-handoff
+// comparisons instead.
+
+// Every heap allocation of the process, counted by the replaced global
+// operator new below.
+std::atomic<uint64_t> heapAllocations(0);
+
+struct SoakResult {
+    uint64_t steps;
+    uint64_t warmUpAllocations;
+    uint64_t soakAllocations;
+    uint64_t poolFallbacks;
+    bool hugePages;
+    double seconds;
+};
+
+int runFixedStepBenchmark(size_t particleCount, int steps, float deltaTime, size_t threads, SimdLevel simdLevel,
+    uint64_t seed, const char* recordPath, const char* snapshotPath);
+int runReplay(const char* path, size_t threads, SimdLevel simdLevel, float tolerance);
+int runLoadSnapshot(const char* path, size_t threads);
+SoakResult soak(size_t particleCount, double seconds, float deltaTime, size_t threads, SimdLevel simdLevel,
+    uint64_t seed, bool pooled, bool hugePages);
+int runSoak(size_t particleCount, double seconds, float deltaTime, size_t threads, SimdLevel simdLevel,
+    uint64_t seed, bool hugePages);
+int runUpdateBenchmark();
+int runThreadBenchmark();
+int runChurnBenchmark();
+int runColliderBenchmark();
+int runPackBenchmark();
+int runEmitBenchmark();
+int runRandomBenchmark();
+int runReplayBenchmark();
+int runSnapshotBenchmark();
+int runSystemBenchmark();
+int runPoolBenchmark();
+int runForceBenchmark();
+int runIntegratorBenchmark();
+int runCullBenchmark();
+int runSortBenchmark();
+int runFrameGraphBenchmark();
+int runStateBufferBenchmark();
+size_t peakResidentBytes();
+
+int main(int argc, char** argv) {
+    size_t particleCount = 100000;
+    int steps = 1000;
+    float deltaTime = 0.005f;
+    size_t threads = 1;
+    SimdLevel simdLevel = DetectSimdLevel();
+    uint64_t seed = 1;
+    const char* recordPath = nullptr;
+    const char* replayPath = nullptr;
+    const char* snapshotPath = nullptr;
+    const char* loadSnapshotPath = nullptr;
+    float tolerance = 0.0f;
+    bool suite = false;
+    double soakSeconds = 0.0;
+    bool hugePages = false;
+
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--suite") == 0) {
+            suite = true;
+        }
+        else if (strcmp(argv[i], "--huge-pages") == 0) {
+            hugePages = true;
+        }
+        else if (strcmp(argv[i], "--soak") == 0 && hasValue) {
+            soakSeconds = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--particles") == 0 && hasValue) {
+            particleCount = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--steps") == 0 && hasValue) {
+            steps = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--dt") == 0 && hasValue) {
+            deltaTime = static_cast<float>(atof(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && hasValue) {
+            threads = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && hasValue) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--record") == 0 && hasValue) {
+            recordPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && hasValue) {
+            replayPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--snapshot") == 0 && hasValue) {
+            snapshotPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--load-snapshot") == 0 && hasValue) {
+            loadSnapshotPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--tolerance") == 0 && hasValue) {
+            tolerance = static_cast<float>(atof(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--simd") == 0 && hasValue) {
+            std::string name = argv[++i];
+            if (name == "scalar")
+                simdLevel = SimdLevel::Scalar;
+            else if (name == "sse2")
+                simdLevel = SimdLevel::SSE2;
+            else if (name == "avx2")
+                simdLevel = SimdLevel::AVX2;
+            else {
+                std::cerr << "Unknown SIMD level: " << name << std::endl;
+                return 1;
+            }
+        }
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--particles N] [--steps N] [--dt SECONDS] [--threads N]"
+                << " [--simd scalar|sse2|avx2] [--seed N] [--record PATH] [--replay PATH [--tolerance T]]"
+                << " [--snapshot PATH] [--load-snapshot PATH] [--soak SECONDS [--huge-pages]] [--suite]"
+                << std::endl;
+            return 1;
+        }
+    }
+
+    if (suite)
+        return runUpdateBenchmark() | runThreadBenchmark() | runChurnBenchmark() | runColliderBenchmark()
+            | runPackBenchmark() | runEmitBenchmark() | runRandomBenchmark() | runReplayBenchmark() | runSnapshotBenchmark()
+            | runSystemBenchmark() | runPoolBenchmark() | runForceBenchmark()
+            | runIntegratorBenchmark() | runCullBenchmark() | runSortBenchmark()
+            | runFrameGraphBenchmark() | runStateBufferBenchmark();
+    if (replayPath != nullptr)
+        return runReplay(replayPath, threads, simdLevel, tolerance);
+    if (soakSeconds > 0.0)
+        return runSoak(particleCount, soakSeconds, deltaTime, threads, simdLevel, seed, hugePages);
+    if (loadSnapshotPath != nullptr)
+        return runLoadSnapshot(loadSnapshotPath, threads);
+    return runFixedStepBenchmark(particleCount, steps, deltaTime, threads, simdLevel, seed, recordPath, snapshotPath);
+}
+
+int runFixedStepBenchmark(size_t particleCount, int steps, float deltaTime, size_t threads, SimdLevel simdLevel,
+    uint64_t seed, const char* recordPath, const char* snapshotPath) {
+    WorkerPool pool(threads);
+    ParticleEmitter emitter;
+    emitter.Seed(seed);
+
+    ParticleRecorder recorder;
+    if (recordPath != nullptr) {
+        if (!recorder.Open(recordPath, emitter)) {
+            std::cerr << "Couldn't open " << recordPath << std::endl;
+            return 1;
+        }
+        emitter.recorder = &recorder;
+    }
+    emitter.simdLevel = simdLevel;
+    emitter.workerPool = &pool;
+    emitter.EmitParticles(particleCount);
+
+    ParticleGenerator generator(&emitter, 0.001f, static_cast<int>(particleCount));
+
+    double updated = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    for (int step = 0; step < steps; ++step) {
+        generator.Update(deltaTime);
+        updated += static_cast<double>(emitter.particles.Size());
+        emitter.Update(deltaTime);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::cout << steps << " steps of " << deltaTime << " s, " << particleCount << " particles, "
+        << pool.ThreadCount() << " threads, " << SimdLevelName(simdLevel) << std::endl;
+    std::cout << "  " << updated / seconds << " particles/s" << std::endl;
+    std::cout << "  " << seconds * 1.0e9 / updated << " ns/particle" << std::endl;
+    std::cout << "  " << peakResidentBytes() / (1024.0 * 1024.0) << " MiB peak RSS" << std::endl;
+    std::cout << "  seed " << seed << ", state checksum " << std::hex << ChecksumParticles(emitter.particles)
+        << std::dec << std::endl;
+
+    if (snapshotPath != nullptr && !ParticleSnapshot::Save(snapshotPath, emitter)) {
+        std::cerr << "Couldn't write " << snapshotPath << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int runReplay(const char* path, size_t threads, SimdLevel simdLevel, float tolerance) {
+    ParticleReplayer replayer;
+    if (!replayer.Open(path)) {
+        std::cerr << "Couldn't read a recording from " << path << std::endl;
+        return 1;
+    }
+
+    WorkerPool pool(threads);
+    ParticleEmitter emitter;
+    emitter.simdLevel = simdLevel;
+    emitter.workerPool = &pool;
+    replayer.Prepare(emitter);
+    ReplayResult result = replayer.Run(emitter);
+
+    std::cout << "Replayed " << result.steps << " steps, " << pool.ThreadCount() << " threads, "
+        << SimdLevelName(simdLevel) << ": " << result.updateSeconds * 1000.0 << " ms in Update()" << std::endl;
+    std::cout << "  " << result.mismatchedSteps << " steps differ (" << result.countMismatchedSteps
+        << " in deaths, collisions or live count)";
+    if (result.mismatchedSteps != 0)
+        std::cout << ", first at step " << result.firstMismatch;
+    std::cout << "; max keyframe error " << result.maxKeyframeError << " over " << result.keyframes << " keyframes" << std::endl;
+
+    bool passed = result.Passed(tolerance);
+    std::cout << "  " << (passed ? "PASS" : "FAIL") << (tolerance > 0.0f ? " within tolerance" : " bit for bit") << std::endl;
+    return passed ? 0 : 1;
+}
+
+int runLoadSnapshot(const char* path, size_t threads) {
+    WorkerPool pool(threads);
+    ParticleEmitter emitter;
+    emitter.workerPool = &pool;
+
+    auto start = std::chrono::steady_clock::now();
+    ParticleSnapshot snapshot;
+    if (!snapshot.Map(path)) {
+        std::cerr << "Couldn't read a snapshot from " << path << std::endl;
+        return 1;
+    }
+    auto mapped = std::chrono::steady_clock::now();
+    snapshot.Restore(emitter);
+    auto restored = std::chrono::steady_clock::now();
+
+    std::cout << "Loaded " << snapshot.Size() << " slots, " << emitter.ParticleCount() << " live: map "
+        << std::chrono::duration<double, std::milli>(mapped - start).count() << " ms, restore "
+        << std::chrono::duration<double, std::milli>(restored - mapped).count() << " ms" << std::endl;
+    std::cout << "  seed " << emitter.EmitSeed() << ", state checksum " << std::hex
+        << ChecksumParticles(emitter.particles) << std::dec << std::endl;
+    return 0;
+}
+
+// The generator emits a quarter faster than particles die, so the population
+// sits at the cap and every death is refilled on the next step: the churn
+// that makes a growing storage reallocate. Warm-up is setting the emitter up
+// and the first life span, after which every particle has been replaced.
+SoakResult soak(size_t particleCount, double seconds, float deltaTime, size_t threads, SimdLevel simdLevel,
+    uint64_t seed, bool pooled, bool hugePages) {
+    WorkerPool pool(threads);
+    uint64_t allocationsBefore = heapAllocations.load();
+    ParticleEmitter emitter;
+    emitter.Seed(seed);
+    emitter.simdLevel = simdLevel;
+    emitter.workerPool = &pool;
+    if (pooled)
+        emitter.UseFixedPool(particleCount, hugePages);
+
+    float life = Particle().life;
+    float emitInterval = life / (static_cast<float>(particleCount) * 1.25f);
+    ParticleGenerator generator(&emitter, emitInterval, static_cast<int>(particleCount));
+    uint64_t warmUpSteps = static_cast<uint64_t>(life / deltaTime) + 1;
+
+    SoakResult result;
+    result.steps = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + std::chrono::duration<double>(seconds);
+    uint64_t warmUpEnd = 0;
+    for (;;) {
+        generator.Update(deltaTime);
+        emitter.Update(deltaTime);
+        ++result.steps;
+        if (result.steps == warmUpSteps)
+            warmUpEnd = heapAllocations.load();
+        // The clock is read every 64 steps, past warm-up so it always ends.
+        if (result.steps > warmUpSteps && result.steps % 64 == 0 && std::chrono::steady_clock::now() >= end)
+            break;
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.warmUpAllocations = warmUpEnd - allocationsBefore;
+    result.soakAllocations = heapAllocations.load() - warmUpEnd;
+    result.poolFallbacks = emitter.Pool() != nullptr ? emitter.Pool()->FallbackAllocations() : 0;
+    result.hugePages = emitter.Pool() != nullptr && emitter.Pool()->HugePages();
+    return result;
+}
+
+int runSoak(size_t particleCount, double seconds, float deltaTime, size_t threads, SimdLevel simdLevel,
+    uint64_t seed, bool hugePages) {
+    SoakResult result = soak(particleCount, seconds, deltaTime, threads, simdLevel, seed, true, hugePages);
+    std::cout << "Soaked " << particleCount << " particles for " << result.seconds << " s, " << result.steps
+        << " steps, " << threads << " threads, " << SimdLevelName(simdLevel)
+        << (result.hugePages ? ", huge pages" : "") << std::endl;
+    std::cout << "  " << result.warmUpAllocations << " heap allocations in warm-up, " << result.soakAllocations
+        << " after, " << result.poolFallbacks << " pool fallbacks" << std::endl;
+    bool passed = result.soakAllocations == 0 && result.poolFallbacks == 0;
+    std::cout << "  " << (passed ? "PASS" : "FAIL") << std::endl;
+    return passed ? 0 : 1;
+}
+
+// Measures ParticleEmitter::Update throughput without opening a window.
+// Every SIMD level the CPU supports runs on the same initial particles, and
+// its final positions are compared against the scalar kernel; any
+// difference fails the run.
+int runUpdateBenchmark() {
+    const size_t particleCounts[] = { 5000, 100000, 1000000 };
+    const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2 };
+    const int steps = 200;
+    const float deltaTime = 0.005f;
+    int result = 0;
+
+    for (size_t particleCount : particleCounts) {
+        ParticleEmitter seed;
+        seed.position = glm::vec3(0.0f, 0.0f, 0.0f);
+        seed.EmitParticles(particleCount);
+
+        ParticleStorage reference;
+        for (SimdLevel level : levels) {
+            if (level > DetectSimdLevel())
+                continue;
+
+            ParticleEmitter emitter;
+            emitter.particles = seed.particles;
+            emitter.simdLevel = level;
+
+            auto start = std::chrono::steady_clock::now();
+            for (int step = 0; step < steps; ++step)
+                emitter.Update(deltaTime);
+            auto end = std::chrono::steady_clock::now();
+
+            bool matches = true;
+            if (level == SimdLevel::Scalar)
+                reference = emitter.particles;
+            else
+                matches = reference.positionX == emitter.particles.positionX
+                    && reference.positionY == emitter.particles.positionY
+                    && reference.positionZ == emitter.particles.positionZ;
+
+            if (!matches)
+                result = 1;
+
+            double seconds = std::chrono::duration<double>(end - start).count();
+            double updated = static_cast<double>(particleCount) * steps;
+            std::cout << particleCount << " particles, " << SimdLevelName(level) << ": "
+                << updated / seconds / 1.0e6 << " M particles/s, "
+                << seconds * 1.0e9 / updated << " ns/particle"
+                << (matches ? "" : " (MISMATCH)") << std::endl;
+        }
+    }
+
+    return result;
+}
+
+// Scales a 1M-particle update from one thread up to the core count. The
+// multithreaded results must match the single-threaded run exactly.
+int runThreadBenchmark() {
+    const size_t particleCount = 1000000;
+    const int steps = 200;
+    const float deltaTime = 0.005f;
+    int result = 0;
+
+    ParticleEmitter seed;
+    seed.position = glm::vec3(0.0f, 0.0f, 0.0f);
+    seed.EmitParticles(particleCount);
+
+    size_t maxThreads = std::thread::hardware_concurrency();
+    if (maxThreads == 0)
+        maxThreads = 1;
+
+    std::vector<size_t> threadCounts;
+    for (size_t threads = 1; threads < maxThreads; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+
+    ParticleStorage reference;
+    double singleThreadSeconds = 0.0;
+    for (size_t threads : threadCounts) {
+        WorkerPool pool(threads);
+        ParticleEmitter emitter;
+        emitter.particles = seed.particles;
+        emitter.workerPool = &pool;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int step = 0; step < steps; ++step)
+            emitter.Update(deltaTime);
+        auto end = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration<double>(end - start).count();
+        bool matches = true;
+        if (threads == 1) {
+            reference = emitter.particles;
+            singleThreadSeconds = seconds;
+        }
+        else {
+            matches = reference.positionX == emitter.particles.positionX
+                && reference.positionY == emitter.particles.positionY
+                && reference.positionZ == emitter.particles.positionZ
+                && reference.life == emitter.particles.life;
+        }
+
+        if (!matches)
+            result = 1;
+
+        double updated = static_cast<double>(particleCount) * steps;
+        std::cout << particleCount << " particles, " << threads << " threads: "
+            << updated / seconds / 1.0e6 << " M particles/s, speedup "
+            << singleThreadSeconds / seconds << "x"
+            << (matches ? "" : " (MISMATCH)") << std::endl;
+    }
+
+    return result;
+}
+
+// Compares the death policies with a generator emitting every 1 ms, once at
+// the app's rate and once 100x faster. Each run first warms up until births
+// and deaths balance, then times generator and emitter updates together.
+int runChurnBenchmark() {
+    const float emitIntervals[] = { 0.001f, 0.00001f };
+    const DeathPolicy policies[] = { DeathPolicy::Compact, DeathPolicy::SwapAndPop, DeathPolicy::FreeList };
+    const char* policyNames[] = { "compact", "swap-and-pop", "free list" };
+    const int warmupSteps = 1500;
+    const int steps = 1000;
+    const float deltaTime = 0.005f;
+
+    for (float emitInterval : emitIntervals) {
+        for (int p = 0; p < 3; ++p) {
+            ParticleEmitter emitter;
+            emitter.position = glm::vec3(0.0f, 0.0f, 0.0f);
+            emitter.particles.deathPolicy = policies[p];
+            ParticleGenerator generator(&emitter, emitInterval, 10000000);
+
+            for (int step = 0; step < warmupSteps; ++step) {
+                generator.Update(deltaTime);
+                emitter.Update(deltaTime);
+            }
+            size_t capacity = emitter.particles.life.capacity();
+
+            auto start = std::chrono::steady_clock::now();
+            for (int step = 0; step < steps; ++step) {
+                generator.Update(deltaTime);
+                emitter.Update(deltaTime);
+            }
+            auto end = std::chrono::steady_clock::now();
+
+            double seconds = std::chrono::duration<double>(end - start).count();
+            std::cout << "emit every " << emitInterval * 1000.0f << " ms, " << policyNames[p] << ": "
+                << emitter.ParticleCount() << " live, "
+                << seconds * 1.0e6 / steps << " us/step"
+                << (emitter.particles.life.capacity() == capacity ? "" : ", reallocated") << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+// Particles spread through a 10-unit cube against a growing number of small
+// spheres, tested brute force and through the spatial grid. Both must leave
+// the same velocities behind.
+int runColliderBenchmark() {
+    const size_t particleCount = 100000;
+    const size_t colliderCounts[] = { 1, 16, 256 };
+    const CollisionMode modes[] = { CollisionMode::BruteForce, CollisionMode::Grid };
+    const char* modeNames[] = { "brute force", "grid" };
+    const int steps = 100;
+    const float deltaTime = 0.005f;
+    int result = 0;
+
+    RandomStream random(1);
+    float place[3];
+    ParticleEmitter seed;
+    seed.particles.Reserve(particleCount);
+    for (size_t i = 0; i < particleCount; ++i) {
+        random.FillUniform(place, 3, 0.0f, 10.0f);
+        seed.position = glm::vec3(place[0], place[1], place[2]);
+        seed.EmitParticle();
+    }
+
+    for (size_t colliderCount : colliderCounts) {
+        std::vector<SphereCollider> colliders(colliderCount);
+        for (SphereCollider& collider : colliders) {
+            random.FillUniform(place, 3, 0.0f, 10.0f);
+            collider.center = glm::vec3(place[0], place[1], place[2]);
+            collider.radius = 0.3f;
+        }
+
+        ParticleStorage reference;
+        for (int m = 0; m < 2; ++m) {
+            ParticleEmitter emitter;
+            emitter.particles = seed.particles;
+            emitter.colliders = colliders;
+            emitter.collisionMode = modes[m];
+
+            auto start = std::chrono::steady_clock::now();
+            for (int step = 0; step < steps; ++step)
+                emitter.Update(deltaTime);
+            auto end = std::chrono::steady_clock::now();
+
+            bool matches = true;
+            if (m == 0)
+                reference = emitter.particles;
+            else
+                matches = reference.velocityX == emitter.particles.velocityX
+                    && reference.velocityY == emitter.particles.velocityY
+                    && reference.velocityZ == emitter.particles.velocityZ;
+
+            if (!matches)
+                result = 1;
+
+            double seconds = std::chrono::duration<double>(end - start).count();
+            std::cout << particleCount << " particles, " << colliderCount << " colliders, " << modeNames[m] << ": "
+                << seconds * 1.0e9 / (static_cast<double>(particleCount) * steps) << " ns/particle"
+                << (matches ? "" : " (MISMATCH)") << std::endl;
+        }
+    }
+
+    return result;
+}
+
+// Packs 1M particles into each render vertex format and reports the upload
+// size per frame next to the 28 bytes per particle of separate vec3
+// position and vec4 color arrays.
+int runPackBenchmark() {
+    const size_t particleCount = 1000000;
+    const RenderVertexFormat formats[] = { RenderVertexFormat::Float3, RenderVertexFormat::Half3,
+        RenderVertexFormat::Billboard, RenderVertexFormat::BillboardHalf };
+    const char* formatNames[] = { "float3 + RGBA8", "half3 + RGBA8", "billboard float4 + RGBA8",
+        "billboard half4 + RGBA8" };
+    const int frames = 50;
+
+    ParticleEmitter emitter;
+    emitter.EmitParticles(particleCount);
+
+    double unpackedBytes = static_cast<double>(particleCount) * (sizeof(glm::vec3) + sizeof(glm::vec4));
+    std::vector<unsigned char> vertices;
+    for (int f = 0; f < 4; ++f) {
+        vertices.resize(particleCount * RenderVertexSize(formats[f]));
+        size_t written = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < frames; ++frame)
+            written = PackRenderVertices(emitter.particles, 0.0025f, 1.0f, formats[f], vertices.data());
+        auto end = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration<double>(end - start).count();
+        double bytes = static_cast<double>(written) * RenderVertexSize(formats[f]);
+        std::cout << particleCount << " particles, " << formatNames[f] << ": "
+            << bytes / (1024.0 * 1024.0) << " MiB/frame (" << unpackedBytes / bytes << "x smaller), "
+            << seconds * 1.0e9 / (static_cast<double>(particleCount) * frames) << " ns/particle to pack" << std::endl;
+    }
+
+    return 0;
+}
+
+// Emits 1M particles three ways: the old per-particle path (three rand()
+// calls per attribute group and an Insert each), EmitParticle() one at a
+// time, and a single EmitParticles() batch. The last two must produce the
+// same particles.
+int runEmitBenchmark() {
+    const size_t particleCount = 1000000;
+    const int repeats = 10;
+    const char* pathNames[] = { "rand() + Insert", "EmitParticle()", "EmitParticles()" };
+
+    ParticleStorage reference;
+    int result = 0;
+    for (int path = 0; path < 3; ++path) {
+        double seconds = 0.0;
+        for (int repeat = 0; repeat < repeats; ++repeat) {
+            // Reserved and touched up front, so only the emit itself is timed.
+            ParticleEmitter emitter;
+            emitter.EmitParticles(particleCount);
+            emitter.particles.Clear();
+            auto start = std::chrono::steady_clock::now();
+            if (path == 0) {
+                for (size_t i = 0; i < particleCount; ++i) {
+                    Particle particle;
+                    particle.position = emitter.position;
+                    particle.velocity = glm::vec3((rand() % 100 - 50) / 100.0f, (rand() % 100 - 50) / 100.0f, (rand() % 100 - 50) / 100.0f);
+                    particle.color = glm::vec4((rand() % 100) / 100.0f, (rand() % 100) / 100.0f, (rand() % 100) / 100.0f, 1.0f);
+                    emitter.particles.Insert(particle);
+                }
+            }
+            else if (path == 1) {
+                for (size_t i = 0; i < particleCount; ++i)
+                    emitter.EmitParticle();
+            }
+            else {
+                emitter.EmitParticles(particleCount);
+            }
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            if (path == 1 && repeat == 0)
+                reference = emitter.particles;
+            if (path == 2 && repeat == 0) {
+                bool same = reference.velocityX == emitter.particles.velocityX
+                    && reference.velocityY == emitter.particles.velocityY
+                    && reference.velocityZ == emitter.particles.velocityZ
+                    && reference.color == emitter.particles.color
+                    && reference.size == emitter.particles.size;
+                if (!same) {
+                    std::cout << "EmitParticles() differs from EmitParticle()" << std::endl;
+                    result = 1;
+                }
+            }
+        }
+        std::cout << particleCount << " emits, " << pathNames[path] << ": "
+            << seconds * 1.0e9 / (static_cast<double>(particleCount) * repeats) << " ns/particle" << std::endl;
+    }
+
+    return result;
+}
+
+// Fills 16M random values from each engine at every SIMD level the CPU
+// supports. All levels must produce the same sequence, and so must a fill
+// split into odd-sized pieces. Also checks that two emitters given the same
+// seed emit the same particles.
+int runRandomBenchmark() {
+    const size_t valueCount = 16 * 1024 * 1024;
+    const size_t timingChunk = 16 * 1024;
+    const RandomEngine engines[] = { RandomEngine::Xoshiro256, RandomEngine::CounterHash };
+    const char* engineNames[] = { "xoshiro256**", "counter hash" };
+    const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2 };
+
+    int result = 0;
+    std::vector<uint32_t> values(valueCount);
+    std::vector<uint32_t> reference;
+    for (int e = 0; e < 2; ++e) {
+        for (SimdLevel level : levels) {
+            if (level > DetectSimdLevel())
+                continue;
+            if (engines[e] == RandomEngine::CounterHash && level != SimdLevel::Scalar)
+                continue;
+
+            // Timed on a cache-sized buffer so memory bandwidth stays out of it.
+            RandomStream timed(42, 3, engines[e]);
+            timed.simdLevel = level;
+            auto start = std::chrono::steady_clock::now();
+            for (size_t done = 0; done < valueCount; done += timingChunk)
+                timed.FillBits(values.data(), timingChunk);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << engineNames[e] << ", " << SimdLevelName(level) << ": "
+                << seconds * 1.0e9 / valueCount << " ns/value" << std::endl;
+
+            RandomStream stream(42, 3, engines[e]);
+            stream.simdLevel = level;
+            stream.FillBits(values.data(), valueCount);
+
+            if (level == SimdLevel::Scalar) {
+                reference = values;
+
+                // Lane 0 of the lockstep generators against a plain Xoshiro256.
+                if (engines[e] == RandomEngine::Xoshiro256) {
+                    Xoshiro256 lane0(42, 3 * RandomStream::LANES);
+                    for (size_t i = 0; i < 1024; i += 2 * RandomStream::LANES) {
+                        uint64_t expected = lane0.Next();
+                        if (values[i] != static_cast<uint32_t>(expected) || values[i + 1] != static_cast<uint32_t>(expected >> 32)) {
+                            std::cout << "  lane 0 differs from Xoshiro256" << std::endl;
+                            result = 1;
+                            break;
+                        }
+                    }
+                }
+
+                RandomStream split(42, 3, engines[e]);
+                for (size_t done = 0, piece = 1; done < valueCount; done += piece, piece = piece * 3 % 1000 + 1) {
+                    size_t n = piece < valueCount - done ? piece : valueCount - done;
+                    split.FillBits(values.data() + done, n);
+                }
+            }
+            if (values != reference) {
+                std::cout << "  differs from the scalar single fill" << std::endl;
+                result = 1;
+            }
+        }
+    }
+
+    ParticleEmitter first, second;
+    first.Seed(7);
+    second.Seed(7);
+    first.EmitParticles(100000);
+    for (int i = 0; i < 1000; ++i)
+        second.EmitParticles(100);
+    if (first.particles.velocityX != second.particles.velocityX || first.particles.color != second.particles.color
+        || first.particles.size != second.particles.size) {
+        std::cout << "Emitters with the same seed emitted different particles" << std::endl;
+        result = 1;
+    }
+
+    return result;
+}
+
+// Records 1000 steps of the app's workload with the scalar kernels, then
+// replays it with every SIMD level the CPU supports, and once through the
+// spatial grid. Each replay must match the recording bit for bit.
+int runReplayBenchmark() {
+    const char* path = "particle_bench_replay.bin";
+    const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2 };
+    const int steps = 1000;
+    const float deltaTime = 0.005f;
+
+    {
+        ParticleEmitter emitter;
+        emitter.simdLevel = SimdLevel::Scalar;
+        ParticleRecorder recorder;
+        if (!recorder.Open(path, emitter)) {
+            std::cout << "Couldn't open " << path << std::endl;
+            return 1;
+        }
+        emitter.recorder = &recorder;
+        ParticleGenerator generator(&emitter, 0.0001f, 100000);
+        for (int step = 0; step < steps; ++step) {
+            generator.Update(deltaTime);
+            emitter.Update(deltaTime);
+        }
+    }
+
+    int result = 0;
+    for (int variant = 0; variant < 4; ++variant) {
+        SimdLevel level = variant < 3 ? levels[variant] : DetectSimdLevel();
+        if (level > DetectSimdLevel())
+            continue;
+
+        ParticleReplayer replayer;
+        ParticleEmitter emitter;
+        emitter.simdLevel = level;
+        emitter.collisionMode = variant < 3 ? CollisionMode::BruteForce : CollisionMode::Grid;
+        if (!replayer.Open(path)) {
+            std::cout << "Couldn't read " << path << std::endl;
+            return 1;
+        }
+        replayer.Prepare(emitter);
+        ReplayResult replay = replayer.Run(emitter);
+
+        std::cout << "replay of " << replay.steps << " steps, " << SimdLevelName(level)
+            << (variant < 3 ? "" : " + grid") << ": " << replay.updateSeconds * 1000.0 << " ms, "
+            << (replay.Passed(0.0f) ? "identical" : "DIFFERS") << std::endl;
+        if (!replay.Passed(0.0f) || replay.steps != steps)
+            result = 1;
+    }
+
+    std::remove(path);
+    return result;
+}
+
+// Saves 10M particles, a seventh of them on the free list, then maps the
+// file, steps the mapping in place and restores it into a new emitter. The
+// restored emitter must match the saved one bit for bit.
+int runSnapshotBenchmark() {
+    const char* path = "particle_bench_snapshot.bin";
+    const size_t particleCount = 10000000;
+    const float deltaTime = 0.005f;
+    typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+    uint64_t checksum;
+    {
+        ParticleEmitter emitter;
+        emitter.particles.deathPolicy = DeathPolicy::FreeList;
+        emitter.EmitParticles(particleCount);
+        for (size_t i = 0; i < particleCount; i += 7)
+            emitter.particles.life[i] = deltaTime * 0.5f;
+        emitter.Update(deltaTime);
+        checksum = ChecksumParticles(emitter.particles);
+
+        auto start = std::chrono::steady_clock::now();
+        if (!ParticleSnapshot::Save(path, emitter)) {
+            std::cout << "Couldn't write " << path << std::endl;
+            return 1;
+        }
+        std::cout << "snapshot of " << particleCount << " particles, save: "
+            << Milliseconds(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+    }
+
+    int result = 0;
+    {
+        ParticleSnapshot snapshot;
+        auto start = std::chrono::steady_clock::now();
+        if (!snapshot.Map(path)) {
+            std::cout << "Couldn't map " << path << std::endl;
+            std::remove(path);
+            return 1;
+        }
+        auto mapped = std::chrono::steady_clock::now();
+
+        ParticleEmitter emitter;
+        snapshot.Restore(emitter);
+        auto restored = std::chrono::steady_clock::now();
+
+        bool same = ChecksumParticles(emitter.particles) == checksum
+            && emitter.particles.LiveCount() == snapshot.Size() - snapshot.Header().freeSlotCount;
+        std::cout << "snapshot of " << particleCount << " particles, map: " << Milliseconds(mapped - start).count()
+            << " ms, restore: " << Milliseconds(restored - mapped).count() << " ms"
+            << (same ? "" : " (MISMATCH)") << std::endl;
+        if (!same)
+            result = 1;
+
+        // In place, the first step also pays for copying every page it writes.
+        ParticleSpan span = snapshot.Span();
+        start = std::chrono::steady_clock::now();
+        IntegrateParticles(DetectSimdLevel(), span, deltaTime, nullptr);
+        auto stepped = std::chrono::steady_clock::now();
+        IntegrateParticles(DetectSimdLevel(), span, deltaTime, nullptr);
+        std::cout << "snapshot of " << particleCount << " particles, in-place step: "
+            << Milliseconds(stepped - start).count() << " ms first, "
+            << Milliseconds(std::chrono::steady_clock::now() - stepped).count() << " ms second" << std::endl;
+    }
+
+    std::remove(path);
+    return result;
+}
+
+// Runs 256 small emitters, first as separate ParticleEmitters with their own
+// generators and then as one ParticleSystem, and packs their particles for
+// drawing: once per emitter against once for the whole system. Every
+// system emitter must end up with the same particles as the emitter seeded
+// like it.
+int runSystemBenchmark() {
+    const size_t emitterCount = 256;
+    const size_t maxParticles = 2000;
+    const float emitInterval = 0.001f;
+    const int steps = 600;
+    const float deltaTime = 0.005f;
+    typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+    WorkerPool pool;
+    ParticleSystem system;
+    system.workerPool = &pool;
+    for (size_t i = 0; i < emitterCount; ++i) {
+        float x = static_cast<float>(i % 16) * 0.25f - 2.0f;
+        float z = static_cast<float>(i / 16) * 0.25f - 2.0f;
+        system.AddEmitter(glm::vec3(x, 0.0f, z), emitInterval, maxParticles);
+    }
+
+    std::vector<ParticleEmitter> emitters(emitterCount);
+    std::vector<ParticleGenerator> generators;
+    for (size_t i = 0; i < emitterCount; ++i) {
+        emitters[i].Seed(system.EmitterSeed(i));
+        emitters[i].position = system.Emitter(i).position;
+        emitters[i].workerPool = &pool;
+        generators.push_back(ParticleGenerator(&emitters[i], emitInterval, static_cast<int>(maxParticles)));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int step = 0; step < steps; ++step) {
+        for (size_t i = 0; i < emitterCount; ++i) {
+            generators[i].Update(deltaTime);
+            emitters[i].Update(deltaTime);
+        }
+    }
+    double separateMs = Milliseconds(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int step = 0; step < steps; ++step)
+        system.Update(deltaTime);
+    double systemMs = Milliseconds(std::chrono::steady_clock::now() - start).count();
+
+    bool same = true;
+    for (size_t i = 0; i < emitterCount && same; ++i) {
+        const ParticleStorage& own = emitters[i].particles;
+        const PooledEmitter& pooled = system.Emitter(i);
+        same = own.Size() == pooled.count
+            && std::equal(own.positionX.begin(), own.positionX.end(), system.particles.positionX.begin() + pooled.begin)
+            && std::equal(own.velocityY.begin(), own.velocityY.end(), system.particles.velocityY.begin() + pooled.begin)
+            && std::equal(own.color.begin(), own.color.end(), system.particles.color.begin() + pooled.begin)
+            && std::equal(own.life.begin(), own.life.end(), system.particles.life.begin() + pooled.begin);
+    }
+
+    std::cout << emitterCount << " emitters, " << system.ParticleCount() << " particles, " << pool.ThreadCount()
+        << " threads, " << steps << " steps: separate " << separateMs << " ms, system " << systemMs << " ms"
+        << (same ? "" : " (MISMATCH)") << std::endl;
+
+    const int packRepeats = 20;
+    std::vector<RenderVertexBillboard> vertices(system.particles.Size());
+    start = std::chrono::steady_clock::now();
+    size_t separateWritten = 0;
+    for (int repeat = 0; repeat < packRepeats; ++repeat) {
+        separateWritten = 0;
+        for (const ParticleEmitter& emitter : emitters)
+            separateWritten += PackRenderVertices(emitter.particles, 0.0f, 1.0f, RenderVertexFormat::Billboard,
+                vertices.data() + separateWritten);
+    }
+    double separatePackMs = Milliseconds(std::chrono::steady_clock::now() - start).count() / packRepeats;
+
+    start = std::chrono::steady_clock::now();
+    size_t systemWritten = 0;
+    for (int repeat = 0; repeat < packRepeats; ++repeat)
+        systemWritten = PackRenderVertices(system.particles, 0.0f, 1.0f, RenderVertexFormat::Billboard, vertices.data());
+    double systemPackMs = Milliseconds(std::chrono::steady_clock::now() - start).count() / packRepeats;
+
+    std::cout << emitterCount << " emitters, pack: " << emitterCount << " buffers " << separatePackMs << " ms, "
+        << "1 buffer " << systemPackMs << " ms" << (separateWritten == systemWritten ? "" : " (COUNT MISMATCH)")
+        << std::endl;
+
+    return same && separateWritten == systemWritten ? 0 : 1;
+}
+
+// Short soaks of 100k churning particles, growing on the heap as before and
+// in a fixed pool, single threaded and on every core. Neither may allocate
+// after warm-up; the pooled one allocates its columns once, up front.
+int runPoolBenchmark() {
+    const size_t particleCount = 100000;
+    const double seconds = 2.0;
+    const float deltaTime = 0.005f;
+    const size_t threadCounts[] = { 1, std::thread::hardware_concurrency() };
+
+    int result = 0;
+    for (size_t t = 0; t < 2; ++t) {
+        size_t threads = threadCounts[t];
+        if (t > 0 && threads <= threadCounts[0])
+            continue;
+        for (int pooled = 0; pooled < 2; ++pooled) {
+            SoakResult soaked = soak(particleCount, seconds, deltaTime, threads, DetectSimdLevel(), 1, pooled != 0, false);
+            std::cout << particleCount << " particles, " << (pooled ? "fixed pool" : "heap") << ", " << threads
+                << " threads: " << soaked.seconds * 1.0e9 / (static_cast<double>(soaked.steps) * particleCount)
+                << " ns/particle, " << soaked.warmUpAllocations << " allocations in warm-up, "
+                << soaked.soakAllocations << " after" << std::endl;
+            if (soaked.soakAllocations != 0 || soaked.poolFallbacks != 0)
+                result = 1;
+        }
+    }
+    return result;
+}
+
+// Runs 1M particles under gravity alone and under every force stage at
+// once, with the forces fused into the integration pass and with one more
+// pass per stage after a pass that only moves the particles. The fused pass
+// must give the same result at every SIMD level.
+int runForceBenchmark() {
+    const size_t particleCount = 1000000;
+    const int steps = 100;
+    const float deltaTime = 0.005f;
+    const SimdLevel level = DetectSimdLevel();
+
+    ParticleEmitter seed;
+    seed.EmitParticles(particleCount);
+
+    ForceField none;
+    none.gravity = 0.0f;
+    ForceField gravity;
+    ForceField all;
+    all.drag = 0.1f;
+    all.wind = glm::vec3(0.2f, 0.0f, 0.1f);
+    all.vortexStrength = 1.0f;
+    all.attractorCount = 2;
+    all.attractors[0].position = glm::vec3(1.0f, 0.0f, 0.0f);
+    all.attractors[0].strength = 0.5f;
+    all.attractors[1].position = glm::vec3(-1.0f, 0.5f, 0.0f);
+    all.attractors[1].strength = 0.5f;
+
+    const ForceField* fields[] = { &gravity, &all };
+    const char* fieldNames[] = { "gravity", "all stages" };
+    int result = 0;
+    for (int f = 0; f < 2; ++f) {
+        const ForceField& forces = *fields[f];
+
+        ParticleStorage fused = seed.particles;
+        ParticleSpan span = fused.Span();
+        auto start = std::chrono::steady_clock::now();
+        for (int step = 0; step < steps; ++step)
+            IntegrateParticles(level, span, deltaTime, forces, Integrator::Euler, nullptr);
+        double fusedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        ParticleStorage separate = seed.particles;
+        span = separate.Span();
+        start = std::chrono::steady_clock::now();
+        for (int step = 0; step < steps; ++step) {
+            IntegrateParticles(level, span, deltaTime, none, Integrator::Euler, nullptr);
+            ApplyForces(level, span, deltaTime, forces);
+        }
+        double separateSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        ParticleStorage reference = seed.particles;
+        span = reference.Span();
+        for (int step = 0; step < steps; ++step)
+            IntegrateParticles(SimdLevel::Scalar, span, deltaTime, forces, Integrator::Euler, nullptr);
+        bool matches = reference.positionX == fused.positionX && reference.positionY == fused.positionY
+            && reference.positionZ == fused.positionZ && reference.velocityX == fused.velocityX
+            && reference.velocityY == fused.velocityY && reference.velocityZ == fused.velocityZ;
+        if (!matches)
+            result = 1;
+
+        double updated = static_cast<double>(particleCount) * steps;
+        std::cout << particleCount << " particles, " << fieldNames[f] << ", " << SimdLevelName(level) << ": fused "
+            << fusedSeconds * 1.0e9 / updated << " ns/particle, one pass per stage "
+            << separateSeconds * 1.0e9 / updated << " ns/particle"
+            << (matches ? "" : " (MISMATCH)") << std::endl;
+    }
+
+    return result;
+}
+
+// Energy of each particle orbiting the attractor of field, in double so
+// the measurement adds no error of its own.
+std::vector<double> orbitEnergies(const ParticleStorage& particles, const ForceField& field) {
+    const ForceAttractor& attractor = field.attractors[0];
+    std::vector<double> energies(particles.Size());
+    for (size_t i = 0; i < particles.Size(); ++i) {
+        double dx = static_cast<double>(particles.positionX[i]) - attractor.position.x;
+        double dy = static_cast<double>(particles.positionY[i]) - attractor.position.y;
+        double dz = static_cast<double>(particles.positionZ[i]) - attractor.position.z;
+        double vx = particles.velocityX[i];
+        double vy = particles.velocityY[i];
+        double vz = particles.velocityZ[i];
+        // The attractor's softened pull is the gradient of this potential.
+        double potential = -attractor.strength / std::sqrt(dx * dx + dy * dy + dz * dz + 0.01);
+        energies[i] = 0.5 * (vx * vx + vy * vy + vz * vz) + potential;
+    }
+    return energies;
+}
+
+// Runs particles on eccentric orbits around one attractor, where energy
+// should be conserved, through every integrator at a few timesteps for the
+// same simulated time. Reports the cost per particle step next to the mean
+// relative energy drift, so a scheme can be picked by the largest timestep
+// that is still accurate enough. Each scheme must match the scalar kernel.
+int runIntegratorBenchmark() {
+    const size_t particleCount = 20000;
+    const float duration = 20.0f;
+    const float deltaTimes[] = { 0.02f, 0.01f, 0.005f };
+    const Integrator integrators[] = { Integrator::Euler, Integrator::SemiImplicitEuler, Integrator::Verlet,
+        Integrator::RK2 };
+    const SimdLevel level = DetectSimdLevel();
+
+    ForceField field;
+    field.gravity = 0.0f;
+    field.attractorCount = 1;
+    field.attractors[0].position = glm::vec3(0.0f);
+    field.attractors[0].strength = 1.0f;
+
+    // Orbits of radius 0.5 to 1.5 in tilted planes, at 90% of circular
+    // speed so they are eccentric.
+    ParticleStorage seed;
+    seed.Append(particleCount);
+    RandomStream random(1);
+    float orbit[3];
+    for (size_t i = 0; i < particleCount; ++i) {
+        random.FillUniform(orbit, 3, 0.0f, 1.0f);
+        float radius = 0.5f + orbit[0];
+        float angle = orbit[1] * 6.2831853f;
+        float tilt = (orbit[2] - 0.5f) * 1.0f;
+        glm::vec3 outward(std::cos(angle), 0.0f, std::sin(angle));
+        glm::vec3 along(-std::sin(angle) * std::cos(tilt), std::sin(tilt), std::cos(angle) * std::cos(tilt));
+        float softened = radius * radius + 0.01f;
+        float speed = 0.9f * radius * std::sqrt(1.0f / (softened * std::sqrt(softened)));
+        seed.positionX[i] = outward.x * radius;
+        seed.positionY[i] = outward.y * radius;
+        seed.positionZ[i] = outward.z * radius;
+        seed.velocityX[i] = along.x * speed;
+        seed.velocityY[i] = along.y * speed;
+        seed.velocityZ[i] = along.z * speed;
+        seed.life[i] = 1.0f;
+    }
+    std::vector<double> initial = orbitEnergies(seed, field);
+
+    int result = 0;
+    for (Integrator integrator : integrators) {
+        for (float deltaTime : deltaTimes) {
+            int steps = static_cast<int>(duration / deltaTime + 0.5f);
+            ParticleStorage particles = seed;
+            ParticleSpan span = particles.Span();
+            auto start = std::chrono::steady_clock::now();
+            for (int step = 0; step < steps; ++step)
+                IntegrateParticles(level, span, deltaTime, field, integrator, nullptr);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            std::vector<double> final = orbitEnergies(particles, field);
+            double drift = 0.0;
+            for (size_t i = 0; i < particleCount; ++i)
+                drift += std::fabs(final[i] - initial[i]) / std::fabs(initial[i]);
+            drift /= static_cast<double>(particleCount);
+
+            // Checked at the largest timestep only, where it is cheapest.
+            bool matches = true;
+            if (deltaTime == deltaTimes[0]) {
+                ParticleStorage reference = seed;
+                span = reference.Span();
+                for (int step = 0; step < steps; ++step)
+                    IntegrateParticles(SimdLevel::Scalar, span, deltaTime, field, integrator, nullptr);
+                matches = reference.positionX == particles.positionX && reference.positionY == particles.positionY
+                    && reference.positionZ == particles.positionZ && reference.velocityX == particles.velocityX
+                    && reference.velocityY == particles.velocityY && reference.velocityZ == particles.velocityZ;
+                if (!matches)
+                    result = 1;
+            }
+
+            std::cout << particleCount << " particles, " << IntegratorName(integrator) << ", dt " << deltaTime << ", "
+                << SimdLevelName(level) << ": " << seconds * 1.0e9 / (static_cast<double>(particleCount) * steps)
+                << " ns/particle, energy drift " << drift << (matches ? "" : " (MISMATCH)") << std::endl;
+        }
+    }
+
+    return result;
+}
+
+// Packs 1M billboards as the renderer does, all of them and only those the
+// frustum culling lets through, with the app's projection and the camera
+// looking at the cloud, past its edge and away from it. Every SIMD level
+// must find the same visible particles.
+int runCullBenchmark() {
+    const size_t particleCount = 1000000;
+    const int frames = 20;
+    const float lookahead = 0.0025f;
+    const float margin = 0.02f;
+    const RenderVertexFormat format = RenderVertexFormat::Billboard;
+    const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2 };
+    typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+    ParticleEmitter emitter;
+    emitter.EmitParticles(particleCount);
+    for (int step = 0; step < 100; ++step)
+        emitter.Update(0.005f);
+    const ParticleStorage& particles = emitter.particles;
+
+    glm::mat4 projection = glm::perspective(glm::radians(30.0f), 1200.0f / 1000.0f, 0.1f, 100.0f);
+    glm::vec3 eye(0.0f, 0.0f, 3.0f);
+    const glm::vec3 targets[] = { glm::vec3(0.0f), glm::vec3(1.2f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 6.0f) };
+    const char* viewNames[] = { "facing the cloud", "cloud at the edge", "looking away" };
+
+    std::vector<unsigned char> vertices(particles.Size() * RenderVertexSize(format));
+    std::vector<uint32_t> visible(particles.Size());
+    std::vector<uint32_t> reference(particles.Size());
+    int result = 0;
+    for (int v = 0; v < 3; ++v) {
+        glm::mat4 view = glm::lookAt(eye, targets[v], glm::vec3(0.0f, 1.0f, 0.0f));
+        Frustum frustum = ExtractFrustum(projection, view);
+
+        bool matches = true;
+        CullResult expected = CullParticles(SimdLevel::Scalar, particles.Span(), lookahead, frustum, margin,
+            reference.data());
+        for (SimdLevel level : levels) {
+            if (level > DetectSimdLevel())
+                continue;
+            CullResult found = CullParticles(level, particles.Span(), lookahead, frustum, margin, visible.data());
+            matches = matches && found.live == expected.live && found.visible == expected.visible
+                && std::equal(visible.begin(), visible.begin() + found.visible, reference.begin());
+        }
+        if (!matches)
+            result = 1;
+
+        size_t packed = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < frames; ++frame)
+            packed = PackRenderVertices(particles, lookahead, 1.0f, format, vertices.data());
+        double allMilliseconds = Milliseconds(std::chrono::steady_clock::now() - start).count() / frames;
+
+        CullResult culled;
+        start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < frames; ++frame) {
+            culled = CullParticles(DetectSimdLevel(), particles.Span(), lookahead, frustum, margin, visible.data());
+            // As the renderer does, with nothing culled the list is skipped.
+            if (culled.visible == culled.live)
+                PackRenderVertices(particles, lookahead, 1.0f, format, vertices.data());
+            else
+                PackRenderVertices(particles, visible.data(), culled.visible, lookahead, 1.0f, format, vertices.data());
+        }
+        double culledMilliseconds = Milliseconds(std::chrono::steady_clock::now() - start).count() / frames;
+
+        double vertexSize = static_cast<double>(RenderVertexSize(format));
+        std::cout << culled.live << " particles, " << viewNames[v] << ": "
+            << 100.0 * static_cast<double>(culled.live - culled.visible) / static_cast<double>(culled.live)
+            << "% culled, upload " << packed * vertexSize / (1024.0 * 1024.0) << " -> "
+            << culled.visible * vertexSize / (1024.0 * 1024.0) << " MiB/frame, pack " << allMilliseconds
+            << " ms, cull + pack " << culledMilliseconds << " ms" << (matches ? "" : " (MISMATCH)") << std::endl;
+    }
+
+    return result;
+}
+
+// True when order holds each of the expected live particles once, furthest
+// first. Depths are recomputed here, so equal ones may differ in the last bit.
+bool isBackToFront(const ParticleStorage& particles, const uint32_t* order, size_t count, size_t expected,
+    float lookahead, const glm::mat4& view) {
+    if (count != expected)
+        return false;
+    std::vector<char> seen(particles.Size(), 0);
+    float previous = -std::numeric_limits<float>::infinity();
+    for (size_t k = 0; k < count; ++k) {
+        uint32_t i = order[k];
+        if (i >= particles.Size() || seen[i] || !particles.IsAlive(i))
+            return false;
+        seen[i] = 1;
+        glm::vec3 position(particles.positionX[i] + particles.velocityX[i] * lookahead,
+            particles.positionY[i] + particles.velocityY[i] * lookahead,
+            particles.positionZ[i] + particles.velocityZ[i] * lookahead);
+        float z = (view * glm::vec4(position, 1.0f)).z;
+        if (z < previous - 1.0e-5f * std::fabs(previous))
+            return false;
+        previous = z;
+    }
+    return true;
+}
+
+// Sorts the live particles back to front as the blended renderer does, over
+// frames of a still camera on paused particles, then of a camera orbiting
+// paused and moving ones. The radix sort runs from scratch on one thread and
+// on the pool, then incrementally from frame to frame; std::sort on the
+// depths is the reference. Every order must be complete and back to front.
+int runSortBenchmark() {
+    const size_t particleCounts[] = { 5000, 1000000 };
+    const int frames = 30;
+    const float lookahead = 0.0025f;
+    const SimdLevel level = DetectSimdLevel();
+    const bool movingParticles[] = { false, false, true };
+    const float orbitSteps[] = { 0.0f, glm::radians(0.25f), glm::radians(0.25f) };
+    const char* scenarioNames[] = { "paused, still camera", "paused, camera orbiting", "moving, camera orbiting" };
+    typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+    WorkerPool pool;
+    int result = 0;
+    for (size_t particleCount : particleCounts) {
+        ParticleEmitter emitter;
+        emitter.EmitParticles(particleCount);
+        for (int step = 0; step < 100; ++step)
+            emitter.Update(0.005f);
+
+        for (int scenario = 0; scenario < 3; ++scenario) {
+            // Full on one thread, full on the pool, incremental on the pool,
+            // then std::sort.
+            double milliseconds[4] = {};
+            int hits = 0, misses = 0;
+            size_t insertedBuckets = 0, radixBuckets = 0;
+            bool valid = true;
+            for (int sorterIndex = 0; sorterIndex < 4; ++sorterIndex) {
+                ParticleStorage particles = emitter.particles;
+                ParticleSpan span = particles.Span();
+                DepthSorter sorter;
+                sorter.workerPool = sorterIndex == 0 ? nullptr : &pool;
+                std::vector<uint32_t> live;
+                std::vector<std::pair<float, uint32_t>> depths;
+                std::vector<uint32_t> reference;
+                for (int frame = 0; frame < frames; ++frame) {
+                    if (movingParticles[scenario])
+                        IntegrateParticles(level, span, 0.005f, nullptr);
+                    float angle = orbitSteps[scenario] * static_cast<float>(frame);
+                    glm::vec3 eye(3.0f * std::sin(angle), 0.5f, 3.0f * std::cos(angle));
+                    glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+                    live.clear();
+                    for (size_t i = 0; i < particles.Size(); ++i) {
+                        if (particles.IsAlive(i))
+                            live.push_back(static_cast<uint32_t>(i));
+                    }
+
+                    auto start = std::chrono::steady_clock::now();
+                    const uint32_t* order;
+                    size_t count;
+                    if (sorterIndex < 3) {
+                        if (sorterIndex < 2)
+                            sorter.Reset();
+                        DepthSortResult sorted = sorter.Sort(std::as_const(particles).Span(), live.data(), live.size(),
+                            lookahead, view);
+                        if (sorterIndex == 2 && sorted.reusedOrder) {
+                            hits += sorted.incremental ? 1 : 0;
+                            misses += sorted.incremental ? 0 : 1;
+                            insertedBuckets += sorted.insertedBuckets;
+                            radixBuckets += sorted.radixBuckets;
+                        }
+                        order = sorter.Order();
+                        count = sorted.count;
+                    }
+                    else {
+                        depths.clear();
+                        for (uint32_t i : live) {
+                            glm::vec3 position(particles.positionX[i] + particles.velocityX[i] * lookahead,
+                                particles.positionY[i] + particles.velocityY[i] * lookahead,
+                                particles.positionZ[i] + particles.velocityZ[i] * lookahead);
+                            depths.emplace_back((view * glm::vec4(position, 1.0f)).z, i);
+                        }
+                        std::sort(depths.begin(), depths.end());
+                        reference.resize(depths.size());
+                        for (size_t k = 0; k < depths.size(); ++k)
+                            reference[k] = depths[k].second;
+                        order = reference.data();
+                        count = reference.size();
+                    }
+                    milliseconds[sorterIndex] += Milliseconds(std::chrono::steady_clock::now() - start).count();
+                    valid = valid && isBackToFront(particles, order, count, live.size(), lookahead, view);
+                }
+            }
+            if (!valid)
+                result = 1;
+
+            std::cout << particleCount << " particles, " << scenarioNames[scenario] << ": full sort "
+                << milliseconds[0] / frames << " ms on 1 thread, " << milliseconds[1] / frames << " ms on "
+                << pool.ThreadCount() << ", incremental " << milliseconds[2] / frames << " ms (" << hits << " hits, "
+                << misses << " misses of " << frames << " frames, " << insertedBuckets << " buckets by insertion, " << radixBuckets
+                << " by radix), std::sort " << milliseconds[3] / frames
+                << " ms" << (valid ? "" : " (WRONG ORDER)") << std::endl;
+        }
+    }
+
+    return result;
+}
+
+// A headless frame loop: two fixed steps, then packing the vertices and
+// copying them out as a stand-in for the upload. Run serially with
+// Update(), as the step graph waited on before packing, and as the step graph
+// overlapped with the packing and copying of the frame before, which is how
+// the app's FramePipeline runs. The steps are the same in all three, so the
+// final states match.
+int runFrameGraphBenchmark() {
+    const size_t particleCount = 200000;
+    const int frames = 100;
+    const int substeps = 2;
+    const float deltaTime = 0.005f;
+    const size_t chunkSize = 4096;
+    const char* loopNames[] = { "serial Update()", "step graph, waited", "step graph, overlapped" };
+    typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+    JobScheduler scheduler;
+    std::vector<RenderVertexFloat3> vertices(particleCount);
+    std::vector<RenderVertexFloat3> uploaded(particleCount);
+    uint64_t reference = 0;
+    int result = 0;
+    for (int loop = 0; loop < 3; ++loop) {
+        ParticleEmitter emitter;
+        emitter.Seed(1);
+        emitter.EmitParticles(particleCount);
+        ParticleGenerator generator(&emitter, 0.001f, static_cast<int>(particleCount));
+
+        JobGraph steps;
+        JobGraph::JobId emit = steps.Add("emit", [&] {
+            generator.Update(deltaTime);
+            emitter.BeginStep(deltaTime);
+        });
+        JobGraph::JobId integrate = steps.AddParallel("integrate", [&] { return emitter.StepSlots(); }, chunkSize,
+            [&](size_t begin, size_t end) { emitter.IntegrateRange(begin, end); });
+        JobGraph::JobId collide = steps.Add("collide", [&] { emitter.CollideStep(); });
+        JobGraph::JobId compact = steps.Add("compact", [&] { emitter.CompactStep(); });
+        steps.Precede(emit, integrate);
+        steps.Precede(integrate, collide);
+        steps.Precede(collide, compact);
+
+        uint64_t stealsBefore = scheduler.Steals();
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < frames; ++frame) {
+            if (loop == 0) {
+                for (int step = 0; step < substeps; ++step) {
+                    generator.Update(deltaTime);
+                    emitter.Update(deltaTime);
+                }
+            }
+            else if (loop == 1) {
+                scheduler.Submit(steps, substeps);
+                scheduler.Wait(steps);
+            }
+            size_t written = PackRenderVertices(emitter.particles, 0.0f, 1.0f, RenderVertexFormat::Float3,
+                vertices.data());
+            if (loop == 2)
+                scheduler.Submit(steps, substeps);
+            std::memcpy(uploaded.data(), vertices.data(), written * sizeof(RenderVertexFloat3));
+            scheduler.Wait(steps);
+        }
+        double milliseconds = Milliseconds(std::chrono::steady_clock::now() - start).count();
+
+        uint64_t checksum = ChecksumParticles(emitter.particles);
+        if (loop == 0)
+            reference = checksum;
+        bool matches = checksum == reference;
+        if (!matches)
+            result = 1;
+        std::cout << particleCount << " particles, " << loopNames[loop] << ": " << milliseconds / frames
+            << " ms/frame on " << scheduler.ThreadCount() << " threads, " << scheduler.Steals() - stealsBefore
+            << " steals" << (matches ? "" : " (MISMATCH)") << std::endl;
+    }
+
+    return result;
+}
+
+// A simulation thread steps an emitter and publishes every step while the
+// main thread keeps acquiring the newest state and checksumming it, as a
+// render thread would pack it. Each checksum must match the one recorded
+// when that state was published, so no state is ever seen half written, and
+// the reader must never fall more than one publish behind what had been
+// published when it acquired.
+int runStateBufferBenchmark() {
+    const size_t particleCount = 200000;
+    const int steps = 300;
+    const float deltaTime = 0.005f;
+    typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+    ParticleEmitter emitter;
+    emitter.Seed(1);
+    emitter.EmitParticles(particleCount);
+    ParticleGenerator generator(&emitter, 0.001f, static_cast<int>(particleCount));
+    ParticleStateBuffer buffer;
+    buffer.Reserve(emitter.particles.Size());
+    // Indexed by sequence; written before the publish that releases it.
+    std::vector<uint64_t> checksums(steps + 1);
+
+    double publishMilliseconds = 0.0;
+    std::thread simulation([&] {
+        for (int step = 1; step <= steps; ++step) {
+            generator.Update(deltaTime);
+            emitter.Update(deltaTime);
+            checksums[step] = ChecksumParticles(emitter.particles);
+            auto start = std::chrono::steady_clock::now();
+            buffer.Publish(emitter.particles);
+            publishMilliseconds += Milliseconds(std::chrono::steady_clock::now() - start).count();
+        }
+    });
+
+    uint64_t frames = 0, torn = 0, lastSequence = 0, distinct = 0, maxLag = 0;
+    while (lastSequence < static_cast<uint64_t>(steps)) {
+        uint64_t publishedBefore = buffer.Publishes();
+        const ParticleStorage& state = buffer.Acquire();
+        uint64_t sequence = buffer.AcquiredSequence();
+        ++frames;
+        if (sequence == 0) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (ChecksumParticles(state) != checksums[sequence])
+            ++torn;
+        if (publishedBefore > sequence)
+            maxLag = std::max(maxLag, publishedBefore - sequence);
+        distinct += sequence != lastSequence ? 1 : 0;
+        lastSequence = sequence;
+    }
+    simulation.join();
+
+    bool valid = torn == 0 && maxLag <= 1;
+    std::cout << particleCount << " particles, " << steps << " published steps: publish "
+        << publishMilliseconds / steps << " ms, " << frames << " acquires saw " << distinct << " states, "
+        << torn << " torn, reader at most " << maxLag << " publish behind" << (valid ? "" : " (INVALID)")
+        << std::endl;
+    return valid ? 0 : 1;
+}
+
+size_t peakResidentBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize;
+    return 0;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+
+// Counts every allocation; the aligned forms are what the particle columns
+// and the pool fallback use. Every form allocates and frees through the
+// same pair below, which g++ cannot see into from a new-expression, so it
+// does not take the free() behind operator delete for a mismatch.
+namespace {
+#if defined(_MSC_VER)
+    __declspec(noinline)
+#else
+    __attribute__((noinline))
+#endif
+    void* AllocateCounted(size_t size, size_t alignment) {
+        heapAllocations.fetch_add(1, std::memory_order_relaxed);
+        if (size == 0)
+            size = 1;
+#ifdef _WIN32
+        void* pointer = _aligned_malloc(size, alignment);
+#else
+        void* pointer = nullptr;
+        if (alignment <= alignof(std::max_align_t))
+            pointer = std::malloc(size);
+        else if (posix_memalign(&pointer, alignment, size) != 0)
+            pointer = nullptr;
+#endif
+        if (pointer == nullptr)
+            throw std::bad_alloc();
+        return pointer;
+    }
+
+#if defined(_MSC_VER)
+    __declspec(noinline)
+#else
+    __attribute__((noinline))
+#endif
+    void FreeCounted(void* pointer) noexcept {
+#ifdef _WIN32
+        _aligned_free(pointer);
+#else
+        std::free(pointer);
+#endif
+    }
+}
+
+void* operator new(size_t size) {
+    return AllocateCounted(size, alignof(std::max_align_t));
+}
+
+void* operator new[](size_t size) {
+    return AllocateCounted(size, alignof(std::max_align_t));
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    return AllocateCounted(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return AllocateCounted(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* pointer) noexcept {
+    FreeCounted(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    FreeCounted(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    FreeCounted(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    FreeCounted(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept {
+    FreeCounted(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept {
+    FreeCounted(pointer);
+}
+
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept {
+    FreeCounted(pointer);
+}
+
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept {
+    FreeCounted(pointer);
+}
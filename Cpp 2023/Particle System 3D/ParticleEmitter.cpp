@@ -0,0 +1,155 @@
+#include "ParticleEmitter.h"
+#include <atomic>
+#include <chrono>
+#include "ParticleRecorder.h"
+
+ParticleEmitter::ParticleEmitter()
+    : position(0.0f, 0.0f, 0.0f), simdLevel(DetectSimdLevel()), workerPool(nullptr),
+      stats(nullptr), recorder(nullptr), integrator(Integrator::Euler), collisionMode(CollisionMode::Automatic),
+      pendingEmits(0), lastCollisions(0), poolCapacity(0), stepDeltaTime(0.0f), stepUsesGrid(false),
+      stepCollisions(0) {
+    Seed(1);
+    SphereCollider sphere;
+    sphere.center = glm::vec3(0.0f, -1.0f, 0.0f);
+    sphere.radius = 0.5f;
+    colliders.push_back(sphere);
+}
+
+void ParticleEmitter::Seed(uint64_t seed, RandomEngine engine) {
+    emitSeed = seed;
+    emitEngine = engine;
+    spawner.Seed(seed, engine);
+}
+
+void ParticleEmitter::UseFixedPool(size_t maxParticles, bool hugePages) {
+    // The old columns go back to the old pool before it is destroyed.
+    std::unique_ptr<ParticlePool> newPool(new ParticlePool(ParticlePool::BytesFor(maxParticles), hugePages));
+    particles.UsePool(newPool.get(), maxParticles);
+    pool = std::move(newPool);
+    poolCapacity = maxParticles;
+}
+
+void ParticleEmitter::EmitParticle() {
+    EmitParticles(1);
+}
+
+void ParticleEmitter::EmitParticles(size_t count) {
+    if (pool != nullptr) {
+        size_t room = poolCapacity > particles.LiveCount() ? poolCapacity - particles.LiveCount() : 0;
+        count = count < room ? count : room;
+    }
+    pendingEmits += count;
+    if (recorder != nullptr)
+        recorder->RecordEmit(position, count);
+
+    size_t reused = count < particles.FreeSlotCount() ? count : particles.FreeSlotCount();
+    if (reused > 0) {
+        spawner.FillFreeSlots(particles, reused, position, simdLevel);
+        count -= reused;
+    }
+
+    if (count > 0)
+        spawner.Fill(particles, particles.Append(count), count, position, simdLevel, workerPool);
+}
+
+void ParticleEmitter::Update(float deltaTime) {
+    BeginStep(deltaTime);
+    size_t slots = StepSlots();
+    if (workerPool != nullptr && slots >= PARALLEL_UPDATE_MIN_PARTICLES) {
+        // Every particle is updated independently, so the result does not
+        // depend on which thread takes which chunk.
+        workerPool->ParallelFor(slots, UpdateChunkSize(slots), [this](size_t begin, size_t end) {
+            IntegrateRange(begin, end);
+        });
+    }
+    else {
+        IntegrateRange(0, slots);
+    }
+    CollideStep();
+    CompactStep();
+}
+
+void ParticleEmitter::BeginStep(float deltaTime) {
+    if (stats != nullptr)
+        stepStart = std::chrono::steady_clock::now();
+    stepDeltaTime = deltaTime;
+    stepUsesGrid = UsesGrid();
+    stepCollisions.store(0, std::memory_order_relaxed);
+}
+
+// Without the grid, the first collider is fused into the integration pass
+// and the rest are tested in the same chunk while it is still in cache.
+void ParticleEmitter::IntegrateRange(size_t begin, size_t end) {
+    const SphereCollider* fused = !stepUsesGrid && !colliders.empty() ? &colliders[0] : nullptr;
+    ParticleSpan range = SliceSpan(particles.Span(), begin, end);
+    size_t collisions = IntegrateParticles(simdLevel, range, stepDeltaTime, forces, integrator, fused);
+    if (fused != nullptr) {
+        for (size_t c = 1; c < colliders.size(); ++c)
+            collisions += CollideSphere(simdLevel, range, colliders[c]);
+    }
+    stepCollisions.fetch_add(collisions, std::memory_order_relaxed);
+}
+
+void ParticleEmitter::CollideStep() {
+    if (stepUsesGrid)
+        stepCollisions.fetch_add(CollideThroughGrid(), std::memory_order_relaxed);
+}
+
+// Compaction reorders the columns, so it runs after all chunks finished.
+void ParticleEmitter::CompactStep() {
+    lastCollisions = stepCollisions.load(std::memory_order_relaxed);
+    size_t liveBefore = particles.LiveCount();
+    particles.RemoveDead();
+    size_t deaths = liveBefore - particles.LiveCount();
+
+    if (stats != nullptr) {
+        stats->AddEmits(pendingEmits);
+        stats->AddDeaths(deaths);
+        stats->SetLiveParticles(particles.LiveCount());
+        stats->AddUpdateTime(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - stepStart).count()));
+    }
+    pendingEmits = 0;
+
+    if (recorder != nullptr)
+        recorder->RecordStep(*this, stepDeltaTime, deaths, lastCollisions);
+}
+
+// A few chunks per thread for load balancing, each a whole number of cache
+// lines so neighbouring chunks never write to the same line.
+size_t ParticleEmitter::UpdateChunkSize(size_t count) const {
+    const size_t floatsPerLine = CACHE_LINE_SIZE / sizeof(float);
+    size_t chunkCount = workerPool->ThreadCount() * 4;
+    size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+    return (chunkSize + floatsPerLine - 1) / floatsPerLine * floatsPerLine;
+}
+
+void ParticleEmitter::BuildGrid() {
+    grid.Build(particles.positionX.data(), particles.positionY.data(), particles.positionZ.data(), particles.Size());
+}
+
+bool ParticleEmitter::UsesGrid() const {
+    switch (collisionMode) {
+    case CollisionMode::BruteForce:
+        return false;
+    case CollisionMode::Grid:
+        return !colliders.empty();
+    default:
+        return colliders.size() > GRID_MIN_COLLIDERS;
+    }
+}
+
+// Collider by collider, like the brute-force path, so both give the same
+// velocities. Reflection leaves positions alone, so one grid serves all.
+size_t ParticleEmitter::CollideThroughGrid() {
+    BuildGrid();
+    ParticleSpan span = particles.Span();
+    size_t collisions = 0;
+    for (const SphereCollider& collider : colliders) {
+        grid.Query(collider.center, collider.radius, [&](size_t index) {
+            if (CollideParticle(span, index, collider))
+                ++collisions;
+        });
+    }
+    return collisions;
+}
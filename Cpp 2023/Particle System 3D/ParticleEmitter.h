@@ -0,0 +1,122 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include "ParticleStorage.h"
+#include "ParticleKernels.h"
+#include "WorkerPool.h"
+#include "ParticleStats.h"
+#include "SpatialHashGrid.h"
+#include "Random.h"
+#include "ParticleSpawner.h"
+#include "ParticlePool.h"
+
+class ParticleRecorder;
+
+enum class CollisionMode {
+    // Brute force for a few colliders, the spatial grid beyond that.
+    Automatic,
+    // Every particle against every collider, vectorized.
+    BruteForce,
+    // Only particles in grid cells a collider overlaps.
+    Grid
+};
+
+// Spawns particles at its position and simulates them. It knows nothing about
+// rendering; ParticleRenderer draws its particles in the app.
+class ParticleEmitter {
+public:
+    glm::vec3 position;
+    ParticleStorage particles;
+    SimdLevel simdLevel;
+    // When set, Update() splits the particles across the pool's threads.
+    WorkerPool* workerPool;
+    // When set, Update() reports emits, deaths, live count and its own time.
+    ParticleStats* stats;
+    // When set, receives every emit batch and every step.
+    ParticleRecorder* recorder;
+
+    // Applied by Update() in the same pass that moves the particles.
+    ForceField forces;
+    // Euler by default; see Integrator for the cost and accuracy of each.
+    Integrator integrator;
+    // Tested in order, so a particle inside two colliders reflects twice.
+    std::vector<SphereCollider> colliders;
+    CollisionMode collisionMode;
+    // Rebuilt by Update() whenever it collides through the grid. BuildGrid()
+    // refreshes it for neighbor queries on demand.
+    SpatialHashGrid grid;
+
+    ParticleEmitter();
+
+    // Restarts the emission random streams. Emitted particles depend only on
+    // the seed and how many were emitted before them, however they are
+    // batched, so two emitters seeded alike emit the same particles. The
+    // constructor seeds with 1.
+    void Seed(uint64_t seed, RandomEngine engine = RandomEngine::Xoshiro256);
+    uint64_t EmitSeed() const { return emitSeed; }
+    RandomEngine EmitEngine() const { return emitEngine; }
+
+    // Moves the particles into a pool of maxParticles slots allocated once,
+    // page aligned and on huge pages if asked for and available, and clears
+    // them. From then on emits beyond maxParticles are dropped, so the
+    // columns never reallocate.
+    void UseFixedPool(size_t maxParticles, bool hugePages = false);
+    const ParticlePool* Pool() const { return pool.get(); }
+
+    void EmitParticle();
+    // Emits count particles in one go: free slots are filled first, the rest
+    // is appended as one range and filled column by column.
+    void EmitParticles(size_t count);
+    void Update(float deltaTime);
+    void BuildGrid();
+
+    // Update() in stages, for callers that schedule the work themselves,
+    // such as a job graph. After BeginStep(), IntegrateRange() moves slots
+    // [begin, end) of the StepSlots() slots and may run on any thread, in
+    // any order; then CollideStep() tests the grid and CompactStep() removes
+    // the dead and reports to stats and the recorder. Update() runs exactly
+    // these, so the result is the same however the ranges are split.
+    void BeginStep(float deltaTime);
+    size_t StepSlots() const { return particles.Size(); }
+    void IntegrateRange(size_t begin, size_t end);
+    void CollideStep();
+    void CompactStep();
+
+    size_t ParticleCount() const {
+        return particles.LiveCount();
+    }
+
+    // Reflections in the last Update(), counting a particle once per
+    // collider it hit.
+    size_t LastCollisions() const { return lastCollisions; }
+
+private:
+    static const size_t PARALLEL_UPDATE_MIN_PARTICLES = 16384;
+
+    // Emits since the last Update(), handed to stats in one atomic add.
+    uint64_t pendingEmits;
+    size_t lastCollisions;
+    uint64_t emitSeed;
+    RandomEngine emitEngine;
+    ParticleSpawner spawner;
+    std::unique_ptr<ParticlePool> pool;
+    size_t poolCapacity;
+
+    // State of the step between BeginStep() and CompactStep().
+    std::chrono::steady_clock::time_point stepStart;
+    float stepDeltaTime;
+    bool stepUsesGrid;
+    std::atomic<size_t> stepCollisions;
+
+    // Above this many colliders, Automatic mode switches to the grid.
+    static const size_t GRID_MIN_COLLIDERS = 64;
+
+    size_t UpdateChunkSize(size_t count) const;
+    bool UsesGrid() const;
+    size_t CollideThroughGrid();
+};
@@ -0,0 +1,29 @@
+#pragma once
+#include "ParticleEmitter.h"
+
+// Emits into an emitter at a fixed interval until it holds maxParticles.
+class ParticleGenerator {
+public:
+    ParticleEmitter* emitter;
+    float emitInterval;
+    float currentTime;
+    int maxParticles;
+
+    ParticleGenerator(ParticleEmitter* _emitter, float _emitInterval, int _maxParticles)
+        : emitter(_emitter), emitInterval(_emitInterval), currentTime(0.0f), maxParticles(_maxParticles) {}
+
+    // Everything due this update is emitted in one batch, clamped once to
+    // the room left below maxParticles. Emits that did not fit stay due.
+    void Update(float deltaTime) {
+        currentTime += deltaTime;
+        if (currentTime < emitInterval)
+            return;
+
+        size_t due = static_cast<size_t>(currentTime / emitInterval);
+        size_t count = emitter->ParticleCount();
+        size_t room = count < static_cast<size_t>(maxParticles) ? static_cast<size_t>(maxParticles) - count : 0;
+        size_t emitted = due < room ? due : room;
+        emitter->EmitParticles(emitted);
+        currentTime -= static_cast<float>(emitted) * emitInterval;
+    }
+};
@@ -0,0 +1,552 @@
+#include "ParticleKernels.h"
+#include <cmath>
+#include <type_traits>
+#include <utility>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PARTICLE_KERNELS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit AVX2 instructions inside functions that opt in;
+// MSVC accepts the intrinsics anywhere.
+#if defined(__GNUC__) || defined(__clang__)
+#define PARTICLE_TARGET_SSE2 __attribute__((target("sse2")))
+#define PARTICLE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PARTICLE_TARGET_SSE2
+#define PARTICLE_TARGET_AVX2
+#endif
+
+namespace {
+
+// One bit per force stage. A kernel is instantiated for every combination,
+// with only the stages in its mask compiled in.
+const unsigned FORCE_GRAVITY = 1;
+const unsigned FORCE_WIND = 2;
+const unsigned FORCE_DRAG = 4;
+const unsigned FORCE_VORTEX = 8;
+const unsigned FORCE_ATTRACTORS = 16;
+const size_t FORCE_STAGE_COUNT = 5;
+const size_t FORCE_MASK_COUNT = 1 << FORCE_STAGE_COUNT;
+const size_t INTEGRATOR_COUNT = 4;
+
+// Added to the squared distance to an attractor.
+const float ATTRACTOR_SOFTENING = 0.01f;
+
+struct IntegrateParams {
+    float deltaTime;
+    float lifeDecay;
+    const ForceField* forces;
+};
+
+// The stages that do anything with these settings.
+unsigned ForceMask(const ForceField& forces) {
+    unsigned mask = 0;
+    if (forces.gravity != 0.0f)
+        mask |= FORCE_GRAVITY;
+    if (forces.wind != glm::vec3(0.0f))
+        mask |= FORCE_WIND;
+    if (forces.drag != 0.0f)
+        mask |= FORCE_DRAG;
+    if (forces.vortexStrength != 0.0f)
+        mask |= FORCE_VORTEX;
+    if (forces.attractorCount > 0)
+        mask |= FORCE_ATTRACTORS;
+    return mask;
+}
+
+// Reflects (vx, vy, vz) if p is strictly inside the sphere and returns
+// whether it did. The centre itself has no normal, so a particle exactly
+// there is left alone.
+inline bool ReflectScalar(float px, float py, float pz, float& vx, float& vy, float& vz,
+    const SphereCollider& sphere, float radiusSquared) {
+    float dx = px - sphere.center.x;
+    float dy = py - sphere.center.y;
+    float dz = pz - sphere.center.z;
+    float distanceSquared = dx * dx + dy * dy + dz * dz;
+    if (distanceSquared < radiusSquared && distanceSquared > 0.0f) {
+        float inverseLength = 1.0f / std::sqrt(distanceSquared);
+        float nx = dx * inverseLength;
+        float ny = dy * inverseLength;
+        float nz = dz * inverseLength;
+        float twiceDot = (nx * vx + ny * vy + nz * vz) * 2.0f;
+        vx = vx - nx * twiceDot;
+        vy = vy - ny * twiceDot;
+        vz = vz - nz * twiceDot;
+        return true;
+    }
+    return false;
+}
+
+// Set bits of a movemask, for counting reflected lanes.
+inline size_t CountLanes(int mask) {
+    size_t count = 0;
+    for (; mask != 0; mask &= mask - 1)
+        ++count;
+    return count;
+}
+
+// Only live particles bounce: free slots and particles that died this step
+// keep their velocity and are not counted as collisions.
+size_t CollideScalar(const ParticleSpan& span, size_t begin, const SphereCollider& sphere) {
+    float radiusSquared = sphere.radius * sphere.radius;
+    size_t collisions = 0;
+    for (size_t i = begin; i < span.count; ++i) {
+        if (span.life[i] > 0.0f && ReflectScalar(span.positionX[i], span.positionY[i], span.positionZ[i],
+            span.velocityX[i], span.velocityY[i], span.velocityZ[i], sphere, radiusSquared))
+            ++collisions;
+    }
+    return collisions;
+}
+
+#if PARTICLE_KERNELS_X86
+
+struct SphereSSE2 {
+    __m128 centerX, centerY, centerZ, radiusSquared;
+};
+
+PARTICLE_TARGET_SSE2
+inline SphereSSE2 LoadSphereSSE2(const SphereCollider& sphere) {
+    SphereSSE2 loaded;
+    loaded.centerX = _mm_set1_ps(sphere.center.x);
+    loaded.centerY = _mm_set1_ps(sphere.center.y);
+    loaded.centerZ = _mm_set1_ps(sphere.center.z);
+    loaded.radiusSquared = _mm_set1_ps(sphere.radius * sphere.radius);
+    return loaded;
+}
+
+// Computes the reflection for all four lanes and blends it in where the lane
+// is alive (life > 0) and inside the sphere. Returns the movemask of those
+// lanes; when it is 0, v is untouched.
+PARTICLE_TARGET_SSE2
+inline int ReflectSSE2(const SphereSSE2& sphere, __m128 life, __m128 px, __m128 py, __m128 pz, __m128& vx, __m128& vy,
+    __m128& vz) {
+    __m128 dx = _mm_sub_ps(px, sphere.centerX);
+    __m128 dy = _mm_sub_ps(py, sphere.centerY);
+    __m128 dz = _mm_sub_ps(pz, sphere.centerZ);
+    __m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    __m128 inside = _mm_and_ps(_mm_cmplt_ps(distanceSquared, sphere.radiusSquared), _mm_cmpgt_ps(distanceSquared, _mm_setzero_ps()));
+    inside = _mm_and_ps(inside, _mm_cmpgt_ps(life, _mm_setzero_ps()));
+    int mask = _mm_movemask_ps(inside);
+    if (mask == 0)
+        return 0;
+
+    __m128 inverseLength = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(distanceSquared));
+    __m128 nx = _mm_mul_ps(dx, inverseLength);
+    __m128 ny = _mm_mul_ps(dy, inverseLength);
+    __m128 nz = _mm_mul_ps(dz, inverseLength);
+    __m128 twiceDot = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, vx), _mm_mul_ps(ny, vy)), _mm_mul_ps(nz, vz)), _mm_set1_ps(2.0f));
+    __m128 rx = _mm_sub_ps(vx, _mm_mul_ps(nx, twiceDot));
+    __m128 ry = _mm_sub_ps(vy, _mm_mul_ps(ny, twiceDot));
+    __m128 rz = _mm_sub_ps(vz, _mm_mul_ps(nz, twiceDot));
+    // SSE2 has no blendv, so select with and/andnot.
+    vx = _mm_or_ps(_mm_and_ps(inside, rx), _mm_andnot_ps(inside, vx));
+    vy = _mm_or_ps(_mm_and_ps(inside, ry), _mm_andnot_ps(inside, vy));
+    vz = _mm_or_ps(_mm_and_ps(inside, rz), _mm_andnot_ps(inside, vz));
+    return mask;
+}
+
+PARTICLE_TARGET_SSE2
+size_t CollideSSE2(const ParticleSpan& span, const SphereCollider& sphere) {
+    SphereSSE2 collider = LoadSphereSSE2(sphere);
+
+    size_t collisions = 0;
+    size_t i = 0;
+    for (; i + 4 <= span.count; i += 4) {
+        __m128 vx = _mm_loadu_ps(span.velocityX + i);
+        __m128 vy = _mm_loadu_ps(span.velocityY + i);
+        __m128 vz = _mm_loadu_ps(span.velocityZ + i);
+        int reflected = ReflectSSE2(collider, _mm_loadu_ps(span.life + i), _mm_loadu_ps(span.positionX + i),
+            _mm_loadu_ps(span.positionY + i),
+            _mm_loadu_ps(span.positionZ + i), vx, vy, vz);
+        if (reflected != 0) {
+            collisions += CountLanes(reflected);
+            _mm_storeu_ps(span.velocityX + i, vx);
+            _mm_storeu_ps(span.velocityY + i, vy);
+            _mm_storeu_ps(span.velocityZ + i, vz);
+        }
+    }
+
+    return collisions + CollideScalar(span, i, sphere);
+}
+
+struct SphereAVX2 {
+    __m256 centerX, centerY, centerZ, radiusSquared;
+};
+
+PARTICLE_TARGET_AVX2
+inline SphereAVX2 LoadSphereAVX2(const SphereCollider& sphere) {
+    SphereAVX2 loaded;
+    loaded.centerX = _mm256_set1_ps(sphere.center.x);
+    loaded.centerY = _mm256_set1_ps(sphere.center.y);
+    loaded.centerZ = _mm256_set1_ps(sphere.center.z);
+    loaded.radiusSquared = _mm256_set1_ps(sphere.radius * sphere.radius);
+    return loaded;
+}
+
+PARTICLE_TARGET_AVX2
+inline int ReflectAVX2(const SphereAVX2& sphere, __m256 life, __m256 px, __m256 py, __m256 pz, __m256& vx, __m256& vy,
+    __m256& vz) {
+    __m256 dx = _mm256_sub_ps(px, sphere.centerX);
+    __m256 dy = _mm256_sub_ps(py, sphere.centerY);
+    __m256 dz = _mm256_sub_ps(pz, sphere.centerZ);
+    __m256 distanceSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+    __m256 inside = _mm256_and_ps(_mm256_cmp_ps(distanceSquared, sphere.radiusSquared, _CMP_LT_OQ),
+        _mm256_cmp_ps(distanceSquared, _mm256_setzero_ps(), _CMP_GT_OQ));
+    inside = _mm256_and_ps(inside, _mm256_cmp_ps(life, _mm256_setzero_ps(), _CMP_GT_OQ));
+    int mask = _mm256_movemask_ps(inside);
+    if (mask == 0)
+        return 0;
+
+    __m256 inverseLength = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(distanceSquared));
+    __m256 nx = _mm256_mul_ps(dx, inverseLength);
+    __m256 ny = _mm256_mul_ps(dy, inverseLength);
+    __m256 nz = _mm256_mul_ps(dz, inverseLength);
+    __m256 twiceDot = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, vx), _mm256_mul_ps(ny, vy)), _mm256_mul_ps(nz, vz)), _mm256_set1_ps(2.0f));
+    vx = _mm256_blendv_ps(vx, _mm256_sub_ps(vx, _mm256_mul_ps(nx, twiceDot)), inside);
+    vy = _mm256_blendv_ps(vy, _mm256_sub_ps(vy, _mm256_mul_ps(ny, twiceDot)), inside);
+    vz = _mm256_blendv_ps(vz, _mm256_sub_ps(vz, _mm256_mul_ps(nz, twiceDot)), inside);
+    return mask;
+}
+
+PARTICLE_TARGET_AVX2
+size_t CollideAVX2(const ParticleSpan& span, const SphereCollider& sphere) {
+    SphereAVX2 collider = LoadSphereAVX2(sphere);
+
+    size_t collisions = 0;
+    size_t i = 0;
+    for (; i + 8 <= span.count; i += 8) {
+        __m256 vx = _mm256_loadu_ps(span.velocityX + i);
+        __m256 vy = _mm256_loadu_ps(span.velocityY + i);
+        __m256 vz = _mm256_loadu_ps(span.velocityZ + i);
+        int reflected = ReflectAVX2(collider, _mm256_loadu_ps(span.life + i), _mm256_loadu_ps(span.positionX + i),
+            _mm256_loadu_ps(span.positionY + i),
+            _mm256_loadu_ps(span.positionZ + i), vx, vy, vz);
+        if (reflected != 0) {
+            collisions += CountLanes(reflected);
+            _mm256_storeu_ps(span.velocityX + i, vx);
+            _mm256_storeu_ps(span.velocityY + i, vy);
+            _mm256_storeu_ps(span.velocityZ + i, vz);
+        }
+    }
+
+    return collisions + CollideScalar(span, i, sphere);
+}
+
+bool CpuSupportsAVX2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx)
+        return false;
+    // The OS must save the YMM registers on context switch.
+    if ((_xgetbv(0) & 0x6) != 0x6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+// The force and culling kernels, once per level. Each level's Ops maps the
+// operations the .inl files are written in onto its registers; scalar comes first, as
+// the vector levels finish their tails with it.
+namespace scalar {
+
+struct Ops {
+    typedef float Float;
+    struct Sphere {
+        SphereCollider sphere;
+        float radiusSquared;
+    };
+    static constexpr size_t WIDTH = 1;
+
+    static Float Load(const float* source) { return *source; }
+    static void Store(float* target, Float value) { *target = value; }
+    static Float Set(float value) { return value; }
+    static Float Zero() { return 0.0f; }
+    static Float Add(Float a, Float b) { return a + b; }
+    static Float Sub(Float a, Float b) { return a - b; }
+    static Float Mul(Float a, Float b) { return a * b; }
+    static Float Div(Float a, Float b) { return a / b; }
+    static Float Sqrt(Float a) { return std::sqrt(a); }
+    // b when either is NaN, as minps does.
+    static Float Min(Float a, Float b) { return a < b ? a : b; }
+    static int GreaterEqualMask(Float a, Float b) { return a >= b ? 1 : 0; }
+    static int GreaterMask(Float a, Float b) { return a > b ? 1 : 0; }
+
+    static Sphere LoadSphere(const SphereCollider& sphere) {
+        Sphere loaded = { sphere, sphere.radius * sphere.radius };
+        return loaded;
+    }
+    static int Reflect(const Sphere& sphere, Float life, Float px, Float py, Float pz, Float& vx, Float& vy,
+        Float& vz) {
+        return life > 0.0f && ReflectScalar(px, py, pz, vx, vy, vz, sphere.sphere, sphere.radiusSquared) ? 1 : 0;
+    }
+    static size_t CountLanes(int mask) { return static_cast<size_t>(mask); }
+};
+
+#include "ForceKernels.inl"
+#include "CullKernels.inl"
+
+}
+
+#if PARTICLE_KERNELS_X86
+
+// GCC and Clang need the instruction set of every function in the
+// namespaces below, templates included, so it is switched on for the whole
+// region rather than per function.
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("sse2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#endif
+
+namespace sse2 {
+
+struct Ops {
+    typedef __m128 Float;
+    typedef SphereSSE2 Sphere;
+    static constexpr size_t WIDTH = 4;
+
+    static Float Load(const float* source) { return _mm_loadu_ps(source); }
+    static void Store(float* target, Float value) { _mm_storeu_ps(target, value); }
+    static Float Set(float value) { return _mm_set1_ps(value); }
+    static Float Zero() { return _mm_setzero_ps(); }
+    static Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+    static Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+    static Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+    static Float Div(Float a, Float b) { return _mm_div_ps(a, b); }
+    static Float Sqrt(Float a) { return _mm_sqrt_ps(a); }
+    static Float Min(Float a, Float b) { return _mm_min_ps(a, b); }
+    static int GreaterEqualMask(Float a, Float b) { return _mm_movemask_ps(_mm_cmpge_ps(a, b)); }
+    static int GreaterMask(Float a, Float b) { return _mm_movemask_ps(_mm_cmpgt_ps(a, b)); }
+
+    static Sphere LoadSphere(const SphereCollider& sphere) { return LoadSphereSSE2(sphere); }
+    static int Reflect(const Sphere& sphere, Float life, Float px, Float py, Float pz, Float& vx, Float& vy,
+        Float& vz) {
+        return ReflectSSE2(sphere, life, px, py, pz, vx, vy, vz);
+    }
+    static size_t CountLanes(int mask) { return ::CountLanes(mask); }
+};
+
+#include "ForceKernels.inl"
+#include "CullKernels.inl"
+
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+namespace avx2 {
+
+struct Ops {
+    typedef __m256 Float;
+    typedef SphereAVX2 Sphere;
+    static constexpr size_t WIDTH = 8;
+
+    static Float Load(const float* source) { return _mm256_loadu_ps(source); }
+    static void Store(float* target, Float value) { _mm256_storeu_ps(target, value); }
+    static Float Set(float value) { return _mm256_set1_ps(value); }
+    static Float Zero() { return _mm256_setzero_ps(); }
+    static Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+    static Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+    static Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+    static Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+    static Float Sqrt(Float a) { return _mm256_sqrt_ps(a); }
+    static Float Min(Float a, Float b) { return _mm256_min_ps(a, b); }
+    static int GreaterEqualMask(Float a, Float b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_GE_OQ)); }
+    static int GreaterMask(Float a, Float b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_GT_OQ)); }
+
+    static Sphere LoadSphere(const SphereCollider& sphere) { return LoadSphereAVX2(sphere); }
+    static int Reflect(const Sphere& sphere, Float life, Float px, Float py, Float pz, Float& vx, Float& vy,
+        Float& vz) {
+        return ReflectAVX2(sphere, life, px, py, pz, vx, vy, vz);
+    }
+    static size_t CountLanes(int mask) { return ::CountLanes(mask); }
+};
+
+#include "ForceKernels.inl"
+#include "CullKernels.inl"
+
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#endif
+
+}
+
+SimdLevel DetectSimdLevel() {
+#if PARTICLE_KERNELS_X86
+    static const SimdLevel detected = CpuSupportsAVX2() ? SimdLevel::AVX2 : SimdLevel::SSE2;
+    return detected;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+const char* SimdLevelName(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::SSE2: return "SSE2";
+    case SimdLevel::AVX2: return "AVX2";
+    default: return "scalar";
+    }
+}
+
+const char* IntegratorName(Integrator integrator) {
+    switch (integrator) {
+    case Integrator::SemiImplicitEuler: return "semi-implicit Euler";
+    case Integrator::Verlet: return "Verlet";
+    case Integrator::RK2: return "RK2";
+    default: return "Euler";
+    }
+}
+
+// Never run a kernel the CPU cannot execute, whatever the caller asked for.
+static SimdLevel ClampSimdLevel(SimdLevel level) {
+    return level > DetectSimdLevel() ? DetectSimdLevel() : level;
+}
+
+ForceField::ForceField()
+    : gravity(0.5f), drag(0.0f), wind(0.0f), vortexCenter(0.0f), vortexAxis(0.0f, 1.0f, 0.0f), vortexStrength(0.0f),
+      attractors(), attractorCount(0) {}
+
+size_t IntegrateParticles(SimdLevel level, const ParticleSpan& span, float deltaTime,
+    const SphereCollider* sphere) {
+    static const ForceField defaultForces;
+    return IntegrateParticles(level, span, deltaTime, defaultForces, Integrator::Euler, sphere);
+}
+
+size_t IntegrateParticles(SimdLevel level, const ParticleSpan& span, float deltaTime, const ForceField& forces,
+    Integrator integrator, const SphereCollider* sphere) {
+    IntegrateParams params;
+    params.deltaTime = deltaTime;
+    params.lifeDecay = deltaTime * 0.5f;
+    params.forces = &forces;
+    unsigned mask = ForceMask(forces);
+
+    switch (ClampSimdLevel(level)) {
+#if PARTICLE_KERNELS_X86
+    case SimdLevel::AVX2:
+        return avx2::SelectIntegrate(integrator, mask)(span, 0, params, sphere);
+    case SimdLevel::SSE2:
+        return sse2::SelectIntegrate(integrator, mask)(span, 0, params, sphere);
+#endif
+    default:
+        return scalar::SelectIntegrate(integrator, mask)(span, 0, params, sphere);
+    }
+}
+
+void ApplyForces(SimdLevel level, const ParticleSpan& span, float deltaTime, const ForceField& forces) {
+    IntegrateParams params;
+    params.deltaTime = deltaTime;
+    params.lifeDecay = 0.0f;
+    params.forces = &forces;
+    unsigned mask = ForceMask(forces);
+
+    level = ClampSimdLevel(level);
+    for (size_t stage = 0; stage < FORCE_STAGE_COUNT; ++stage) {
+        if ((mask & (1u << stage)) == 0)
+            continue;
+        switch (level) {
+#if PARTICLE_KERNELS_X86
+        case SimdLevel::AVX2:
+            avx2::SelectApply(stage)(span, 0, params);
+            break;
+        case SimdLevel::SSE2:
+            sse2::SelectApply(stage)(span, 0, params);
+            break;
+#endif
+        default:
+            scalar::SelectApply(stage)(span, 0, params);
+            break;
+        }
+    }
+}
+
+size_t CollideSphere(SimdLevel level, const ParticleSpan& span, const SphereCollider& sphere) {
+    switch (ClampSimdLevel(level)) {
+#if PARTICLE_KERNELS_X86
+    case SimdLevel::AVX2:
+        return CollideAVX2(span, sphere);
+    case SimdLevel::SSE2:
+        return CollideSSE2(span, sphere);
+#endif
+    default:
+        return CollideScalar(span, 0, sphere);
+    }
+}
+
+bool CollideParticle(const ParticleSpan& span, size_t index, const SphereCollider& sphere) {
+    return span.life[index] > 0.0f && ReflectScalar(span.positionX[index], span.positionY[index], span.positionZ[index],
+        span.velocityX[index], span.velocityY[index], span.velocityZ[index], sphere, sphere.radius * sphere.radius);
+}
+
+Frustum ExtractFrustum(const glm::mat4& projection, const glm::mat4& view, float maxDistance) {
+    // Gribb and Hartmann: each plane is the last row of the clip matrix plus
+    // or minus one of the others. glm indexes [column][row].
+    glm::mat4 clip = projection * view;
+    glm::vec4 rows[4];
+    for (int r = 0; r < 4; ++r)
+        rows[r] = glm::vec4(clip[0][r], clip[1][r], clip[2][r], clip[3][r]);
+
+    Frustum frustum;
+    frustum.planes[0] = rows[3] + rows[0];
+    frustum.planes[1] = rows[3] - rows[0];
+    frustum.planes[2] = rows[3] + rows[1];
+    frustum.planes[3] = rows[3] - rows[1];
+    frustum.planes[4] = rows[3] + rows[2];
+    frustum.planes[5] = rows[3] - rows[2];
+    for (glm::vec4& plane : frustum.planes)
+        plane /= glm::length(glm::vec3(plane));
+
+    if (maxDistance > 0.0f) {
+        // The camera looks down -z of its view space.
+        glm::mat4 cameraToWorld = glm::inverse(view);
+        glm::vec3 eye(cameraToWorld[3]);
+        glm::vec3 forward = -glm::normalize(glm::vec3(cameraToWorld[2]));
+        glm::vec4 limit(-forward, glm::dot(forward, eye) + maxDistance);
+        if (limit.w < frustum.planes[5].w)
+            frustum.planes[5] = limit;
+    }
+    return frustum;
+}
+
+CullResult CullParticles(SimdLevel level, const ConstParticleSpan& span, float lookahead, const Frustum& frustum,
+    float margin, uint32_t* visible) {
+    switch (ClampSimdLevel(level)) {
+#if PARTICLE_KERNELS_X86
+    case SimdLevel::AVX2:
+        return avx2::CullRange(span, 0, lookahead, frustum, margin, visible, CullResult());
+    case SimdLevel::SSE2:
+        return sse2::CullRange(span, 0, lookahead, frustum, margin, visible, CullResult());
+#endif
+    default:
+        return scalar::CullRange(span, 0, lookahead, frustum, margin, visible, CullResult());
+    }
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// Column pointers for a contiguous run of particles handed to a kernel.
+struct ParticleSpan {
+    float* positionX;
+    float* positionY;
+    float* positionZ;
+    float* velocityX;
+    float* velocityY;
+    float* velocityZ;
+    float* life;
+    size_t count;
+};
+
+// Read-only column pointers, for kernels that only look at the particles.
+struct ConstParticleSpan {
+    const float* positionX;
+    const float* positionY;
+    const float* positionZ;
+    const float* velocityX;
+    const float* velocityY;
+    const float* velocityZ;
+    const float* life;
+    size_t count;
+};
+
+// Particles [begin, end) of span.
+inline ParticleSpan SliceSpan(const ParticleSpan& span, size_t begin, size_t end) {
+    ParticleSpan slice;
+    slice.positionX = span.positionX + begin;
+    slice.positionY = span.positionY + begin;
+    slice.positionZ = span.positionZ + begin;
+    slice.velocityX = span.velocityX + begin;
+    slice.velocityY = span.velocityY + begin;
+    slice.velocityZ = span.velocityZ + begin;
+    slice.life = span.life + begin;
+    slice.count = end - begin;
+    return slice;
+}
+
+enum class SimdLevel {
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+// Highest instruction set supported by both the CPU and this build.
+SimdLevel DetectSimdLevel();
+const char* SimdLevelName(SimdLevel level);
+
+// Particles inside the sphere have their velocity mirrored about the
+// surface normal, as glm::reflect does.
+struct SphereCollider {
+    glm::vec3 center;
+    float radius;
+};
+
+const size_t MAX_ATTRACTORS = 4;
+
+struct ForceAttractor {
+    glm::vec3 position;
+    float strength;
+};
+
+// Accelerations applied to every particle, as stages of one pipeline:
+// gravity pulls down, wind pushes along a constant vector, drag slows in
+// proportion to velocity, the vortex swirls around an axis through its
+// center and each attractor pulls with softened inverse-square strength.
+// Stages left at zero cost nothing. The default is the plain gravity the
+// emitters always had.
+struct ForceField {
+    float gravity;
+    float drag;
+    glm::vec3 wind;
+    glm::vec3 vortexCenter;
+    // Unit length; the swirl is counterclockwise looking down the axis.
+    glm::vec3 vortexAxis;
+    float vortexStrength;
+    ForceAttractor attractors[MAX_ATTRACTORS];
+    size_t attractorCount;
+
+    ForceField();
+};
+
+// How IntegrateParticles advances a step. Each scheme is a compile-time
+// policy of the kernels; this picks the instantiation. The second-order
+// schemes evaluate the forces twice per step but keep far less energy error
+// at a given timestep, so they can take larger steps.
+enum class Integrator {
+    // Moves with the old velocity, then accelerates at the new position.
+    // The original update order, bit for bit.
+    Euler,
+    // Accelerates at the old position, then moves with the new velocity:
+    // the textbook form of the same first-order scheme, at the same cost.
+    SemiImplicitEuler,
+    // Velocity Verlet.
+    Verlet,
+    // Second-order Runge-Kutta, the midpoint method.
+    RK2
+};
+
+const char* IntegratorName(Integrator integrator);
+
+// Ages the particles, advances them one step under the forces and, when
+// sphere is not null, reflects them off it, all in one pass over the
+// columns. Only particles still alive after aging (life > 0) reflect, here
+// and in the collision calls below, so free slots never count as
+// collisions. All levels perform the same float operations, so their results
+// match bit for bit. Returns the number of particles reflected.
+size_t IntegrateParticles(SimdLevel level, const ParticleSpan& span, float deltaTime, const ForceField& forces,
+    Integrator integrator, const SphereCollider* sphere);
+// The same with the default ForceField and Euler.
+size_t IntegrateParticles(SimdLevel level, const ParticleSpan& span, float deltaTime,
+    const SphereCollider* sphere);
+
+// Applies the forces to velocity only, one pass per stage, as the update did
+// before the stages were fused. For comparing against in benchmarks.
+void ApplyForces(SimdLevel level, const ParticleSpan& span, float deltaTime, const ForceField& forces);
+
+// Collision test and reflection only, for colliders after the fused one.
+// Returns the number of particles reflected.
+size_t CollideSphere(SimdLevel level, const ParticleSpan& span, const SphereCollider& sphere);
+
+// Scalar reflection of a single particle, bit-identical to the kernels above.
+// Used for particles found through the spatial grid. Returns whether the
+// particle reflected.
+bool CollideParticle(const ParticleSpan& span, size_t index, const SphereCollider& sphere);
+
+// The six planes of a view frustum as (normal, distance), normals unit
+// length and pointing inward, so dot(normal, p) + distance is how far p is
+// inside the plane.
+struct Frustum {
+    glm::vec4 planes[6];
+};
+
+// Extracts the frustum of projection * view. A maxDistance above 0 pulls
+// the far plane in to that distance from the eye when it is nearer than the
+// projection's own.
+Frustum ExtractFrustum(const glm::mat4& projection, const glm::mat4& view, float maxDistance = 0.0f);
+
+struct CullResult {
+    // Live particles tested.
+    size_t live;
+    // Of those, the ones written to the index list.
+    size_t visible;
+
+    CullResult() : live(0), visible(0) {}
+};
+
+// Writes the indices of the live particles that are within margin of the
+// frustum to visible, in order. Positions are moved lookahead seconds along
+// the velocity first, as the render vertices are. visible must have room
+// for span.count indices. All levels find the same particles.
+CullResult CullParticles(SimdLevel level, const ConstParticleSpan& span, float lookahead, const Frustum& frustum,
+    float margin, uint32_t* visible);
@@ -0,0 +1,112 @@
+#include "ParticlePool.h"
+#include <new>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace {
+    const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+    // Eight float columns and the RGBA8 color column.
+    const size_t COLUMN_COUNT = 9;
+
+    size_t RoundUp(size_t value, size_t multiple) {
+        return (value + multiple - 1) / multiple * multiple;
+    }
+
+    // Large pages need SeLockMemoryPrivilege on Windows and reserved pages
+    // (vm.nr_hugepages) on Linux, so both are only tried.
+    void* MapHugePages(size_t bytes) {
+#ifdef _WIN32
+        size_t largePage = GetLargePageMinimum();
+        if (largePage == 0 || bytes % largePage != 0)
+            return nullptr;
+        return VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+#elif defined(MAP_HUGETLB)
+        void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        return memory == MAP_FAILED ? nullptr : memory;
+#else
+        return nullptr;
+#endif
+    }
+
+    void* MapPages(size_t bytes) {
+#ifdef _WIN32
+        return VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+        void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return memory == MAP_FAILED ? nullptr : memory;
+#endif
+    }
+
+    void UnmapPages(void* memory, size_t bytes) {
+#ifdef _WIN32
+        VirtualFree(memory, 0, MEM_RELEASE);
+#else
+        munmap(memory, bytes);
+#endif
+    }
+}
+
+ParticlePool::ParticlePool(size_t bytes, bool _hugePages)
+    : memory(nullptr), capacityBytes(RoundUp(bytes, _hugePages ? HUGE_PAGE_SIZE : POOL_PAGE_SIZE)), usedBytes(0),
+      hugePages(false), mapped(true), fallbackAllocations(0) {
+    if (capacityBytes == 0)
+        return;
+
+    if (_hugePages) {
+        memory = static_cast<unsigned char*>(MapHugePages(capacityBytes));
+        hugePages = memory != nullptr;
+    }
+    if (memory == nullptr) {
+        memory = static_cast<unsigned char*>(MapPages(capacityBytes));
+#if defined(MADV_HUGEPAGE)
+        // Transparent huge pages only back 2 MiB-aligned ranges, which a
+        // large enough mapping contains.
+        if (memory != nullptr && _hugePages)
+            hugePages = madvise(memory, capacityBytes, MADV_HUGEPAGE) == 0;
+#endif
+    }
+    if (memory == nullptr) {
+        memory = static_cast<unsigned char*>(::operator new(capacityBytes, std::align_val_t(POOL_PAGE_SIZE), std::nothrow));
+        mapped = false;
+    }
+    if (memory == nullptr)
+        capacityBytes = 0;
+}
+
+ParticlePool::~ParticlePool() {
+    if (memory == nullptr)
+        return;
+    if (mapped)
+        UnmapPages(memory, capacityBytes);
+    else
+        ::operator delete(memory, std::align_val_t(POOL_PAGE_SIZE));
+}
+
+size_t ParticlePool::BytesFor(size_t capacity) {
+    return COLUMN_COUNT * RoundUp(capacity * sizeof(float), POOL_PAGE_SIZE);
+}
+
+void* ParticlePool::Allocate(size_t bytes) {
+    size_t size = RoundUp(bytes, POOL_PAGE_SIZE);
+    if (size > capacityBytes - usedBytes)
+        return nullptr;
+    void* block = memory + usedBytes;
+    usedBytes += size;
+    return block;
+}
+
+void ParticlePool::Deallocate(void* pointer, size_t bytes) {
+    size_t size = RoundUp(bytes, POOL_PAGE_SIZE);
+    if (static_cast<unsigned char*>(pointer) + size == memory + usedBytes)
+        usedBytes -= size;
+}
+
+bool ParticlePool::Owns(const void* pointer) const {
+    const unsigned char* address = static_cast<const unsigned char*>(pointer);
+    return memory != nullptr && address >= memory && address < memory + capacityBytes;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "AlignedAllocator.h"
+
+const size_t POOL_PAGE_SIZE = 4096;
+
+// One block of memory reserved up front for the columns of a fixed-capacity
+// ParticleStorage. Blocks are handed out page aligned by bumping a pointer;
+// nothing is returned to the OS before the pool is destroyed. With huge
+// pages asked for, the pool tries explicit huge pages first, then
+// transparent ones, then plain pages, and HugePages() says what it got.
+class ParticlePool {
+public:
+    ParticlePool(size_t bytes, bool hugePages = false);
+    ~ParticlePool();
+
+    ParticlePool(const ParticlePool&) = delete;
+    ParticlePool& operator=(const ParticlePool&) = delete;
+
+    // Bytes the columns of a storage with room for capacity particles take.
+    static size_t BytesFor(size_t capacity);
+
+    // Null when the pool is full; the caller falls back to the heap.
+    void* Allocate(size_t bytes);
+    // Only the newest block is really freed; older ones stay used.
+    void Deallocate(void* pointer, size_t bytes);
+    bool Owns(const void* pointer) const;
+
+    size_t CapacityBytes() const { return capacityBytes; }
+    size_t UsedBytes() const { return usedBytes; }
+    bool HugePages() const { return hugePages; }
+    // Allocations that did not fit and went to the heap. Stays 0 as long as
+    // the storage never grows past the capacity it was sized for.
+    uint64_t FallbackAllocations() const { return fallbackAllocations.load(std::memory_order_relaxed); }
+    void CountFallback() { fallbackAllocations.fetch_add(1, std::memory_order_relaxed); }
+
+private:
+    unsigned char* memory;
+    size_t capacityBytes;
+    size_t usedBytes;
+    bool hugePages;
+    // How memory was obtained, so it is released the same way.
+    bool mapped;
+    std::atomic<uint64_t> fallbackAllocations;
+};
+
+// Allocator of the particle columns: from its pool when it has one and the
+// pool has room, otherwise from the heap, cache-line aligned. Moving a
+// column takes its allocator along; copying one does not, so a copy of a
+// pooled storage lives on the heap.
+template <typename T>
+class ColumnAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    ParticlePool* pool;
+
+    ColumnAllocator() noexcept : pool(nullptr) {}
+    explicit ColumnAllocator(ParticlePool* _pool) noexcept : pool(_pool) {}
+
+    template <typename U>
+    ColumnAllocator(const ColumnAllocator<U>& other) noexcept : pool(other.pool) {}
+
+    ColumnAllocator select_on_container_copy_construction() const { return ColumnAllocator(); }
+
+    T* allocate(size_t count) {
+        if (pool != nullptr) {
+            void* block = pool->Allocate(count * sizeof(T));
+            if (block != nullptr)
+                return static_cast<T*>(block);
+            pool->CountFallback();
+        }
+        return AlignedAllocator<T, CACHE_LINE_SIZE>().allocate(count);
+    }
+
+    void deallocate(T* pointer, size_t count) noexcept {
+        if (pool != nullptr && pool->Owns(pointer))
+            pool->Deallocate(pointer, count * sizeof(T));
+        else
+            AlignedAllocator<T, CACHE_LINE_SIZE>().deallocate(pointer, count);
+    }
+
+    template <typename U>
+    bool operator==(const ColumnAllocator<U>& other) const noexcept { return pool == other.pool; }
+
+    template <typename U>
+    bool operator!=(const ColumnAllocator<U>& other) const noexcept { return pool != other.pool; }
+};
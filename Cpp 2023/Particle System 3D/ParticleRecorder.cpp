@@ -0,0 +1,274 @@
+#include "ParticleRecorder.h"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include "ParticleEmitter.h"
+
+namespace {
+    template <typename Column>
+    uint64_t HashColumn(uint64_t hash, const Column& column) {
+        static_assert(sizeof(column[0]) == sizeof(uint32_t), "columns are 32 bits wide");
+        for (size_t i = 0; i < column.size(); ++i) {
+            uint32_t word;
+            std::memcpy(&word, &column[i], sizeof(word));
+            hash = (hash ^ word) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    template <typename Column>
+    void WriteColumn(std::ofstream& file, const Column& column) {
+        file.write(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(column[0]));
+    }
+
+    template <typename Column>
+    bool ReadColumn(std::ifstream& file, Column& column, size_t count) {
+        column.resize(count);
+        file.read(reinterpret_cast<char*>(column.data()), count * sizeof(column[0]));
+        return static_cast<bool>(file);
+    }
+
+    // Equal values, including two infinite free-slot lives, count as no error.
+    float ColumnError(const FloatColumn& recorded, const FloatColumn& replayed) {
+        float error = 0.0f;
+        for (size_t i = 0; i < recorded.size(); ++i) {
+            if (recorded[i] == replayed[i])
+                continue;
+            float difference = std::fabs(recorded[i] - replayed[i]);
+            if (std::isnan(difference))
+                return std::numeric_limits<float>::infinity();
+            if (difference > error)
+                error = difference;
+        }
+        return error;
+    }
+}
+
+// 32-bit FNV-1a steps over whole words rather than bytes.
+uint64_t ChecksumParticles(const ParticleStorage& particles) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = HashColumn(hash, particles.positionX);
+    hash = HashColumn(hash, particles.positionY);
+    hash = HashColumn(hash, particles.positionZ);
+    hash = HashColumn(hash, particles.velocityX);
+    hash = HashColumn(hash, particles.velocityY);
+    hash = HashColumn(hash, particles.velocityZ);
+    hash = HashColumn(hash, particles.color);
+    hash = HashColumn(hash, particles.size);
+    hash = HashColumn(hash, particles.life);
+    return hash;
+}
+
+// The emitter must not have emitted since it was seeded, or the replay will
+// start from a different random state.
+bool ParticleRecorder::Open(const char* path, const ParticleEmitter& emitter) {
+    Close();
+    file.open(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    RecordingHeader header;
+    header.seed = emitter.EmitSeed();
+    header.engine = static_cast<uint32_t>(emitter.EmitEngine());
+    header.deathPolicy = static_cast<uint32_t>(emitter.particles.deathPolicy);
+    header.collisionMode = static_cast<uint32_t>(emitter.collisionMode);
+    header.colliderCount = static_cast<uint32_t>(emitter.colliders.size());
+    header.keyframeInterval = keyframeInterval;
+    header.reserved = 0;
+
+    uint32_t version = FILE_VERSION;
+    file.write("PREC", 4);
+    file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(emitter.colliders.data()), emitter.colliders.size() * sizeof(SphereCollider));
+
+    pendingEmits.clear();
+    steps = 0;
+    return static_cast<bool>(file);
+}
+
+void ParticleRecorder::Close() {
+    if (file.is_open())
+        file.close();
+    pendingEmits.clear();
+}
+
+void ParticleRecorder::RecordEmit(const glm::vec3& position, size_t count) {
+    if (!file.is_open() || count == 0)
+        return;
+
+    // Consecutive batches from the same place merge into one record.
+    if (!pendingEmits.empty()) {
+        RecordedEmit& last = pendingEmits.back();
+        if (last.x == position.x && last.y == position.y && last.z == position.z) {
+            last.count += static_cast<uint32_t>(count);
+            return;
+        }
+    }
+
+    RecordedEmit emit;
+    emit.x = position.x;
+    emit.y = position.y;
+    emit.z = position.z;
+    emit.count = static_cast<uint32_t>(count);
+    pendingEmits.push_back(emit);
+}
+
+void ParticleRecorder::RecordStep(const ParticleEmitter& emitter, float deltaTime, size_t deaths, size_t collisions) {
+    if (!file.is_open())
+        return;
+
+    ++steps;
+    const ParticleStorage& particles = emitter.particles;
+    RecordedStep step;
+    step.deltaTime = deltaTime;
+    step.hasKeyframe = keyframeInterval != 0 && steps % keyframeInterval == 0;
+    step.deaths = deaths;
+    step.collisions = collisions;
+    step.liveParticles = particles.LiveCount();
+    step.checksum = ChecksumParticles(particles);
+
+    uint32_t batchCount = static_cast<uint32_t>(pendingEmits.size());
+    file.write(reinterpret_cast<const char*>(&batchCount), sizeof(batchCount));
+    file.write(reinterpret_cast<const char*>(pendingEmits.data()), pendingEmits.size() * sizeof(RecordedEmit));
+    file.write(reinterpret_cast<const char*>(&step), sizeof(step));
+    pendingEmits.clear();
+
+    if (step.hasKeyframe) {
+        uint64_t size = particles.Size();
+        file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        WriteColumn(file, particles.positionX);
+        WriteColumn(file, particles.positionY);
+        WriteColumn(file, particles.positionZ);
+        WriteColumn(file, particles.velocityX);
+        WriteColumn(file, particles.velocityY);
+        WriteColumn(file, particles.velocityZ);
+        WriteColumn(file, particles.color);
+        WriteColumn(file, particles.size);
+        WriteColumn(file, particles.life);
+    }
+}
+
+bool ReplayResult::Passed(float tolerance) const {
+    if (!opened)
+        return false;
+    if (tolerance <= 0.0f)
+        return mismatchedSteps == 0 && maxKeyframeError == 0.0f;
+    return countMismatchedSteps == 0 && keyframes != 0 && maxKeyframeError <= tolerance;
+}
+
+bool ParticleReplayer::Open(const char* path) {
+    if (file.is_open())
+        file.close();
+    file.open(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    char magic[4];
+    uint32_t version = 0;
+    file.read(magic, 4);
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    if (!file || std::memcmp(magic, "PREC", 4) != 0 || version != ParticleRecorder::FILE_VERSION)
+        return false;
+
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    colliders.resize(header.colliderCount);
+    file.read(reinterpret_cast<char*>(colliders.data()), colliders.size() * sizeof(SphereCollider));
+    return static_cast<bool>(file);
+}
+
+void ParticleReplayer::Prepare(ParticleEmitter& emitter) const {
+    emitter.particles.Clear();
+    emitter.particles.deathPolicy = static_cast<DeathPolicy>(header.deathPolicy);
+    emitter.colliders = colliders;
+    emitter.Seed(header.seed, static_cast<RandomEngine>(header.engine));
+}
+
+ReplayResult ParticleReplayer::Run(ParticleEmitter& emitter) {
+    ReplayResult result;
+    result.opened = file.is_open() && static_cast<bool>(file);
+    result.steps = 0;
+    result.mismatchedSteps = 0;
+    result.countMismatchedSteps = 0;
+    result.firstMismatch = 0;
+    result.keyframes = 0;
+    result.maxKeyframeError = 0.0f;
+    result.updateSeconds = 0.0;
+    if (!result.opened)
+        return result;
+
+    std::vector<RecordedEmit> emits;
+    ParticleStorage keyframe;
+    bool mismatched = false;
+
+    for (;;) {
+        uint32_t batchCount = 0;
+        file.read(reinterpret_cast<char*>(&batchCount), sizeof(batchCount));
+        if (!file)
+            break;
+        emits.resize(batchCount);
+        file.read(reinterpret_cast<char*>(emits.data()), emits.size() * sizeof(RecordedEmit));
+        RecordedStep step;
+        file.read(reinterpret_cast<char*>(&step), sizeof(step));
+        if (!file)
+            break;
+
+        for (const RecordedEmit& emit : emits) {
+            emitter.position = glm::vec3(emit.x, emit.y, emit.z);
+            emitter.EmitParticles(emit.count);
+        }
+
+        size_t liveBefore = emitter.particles.LiveCount();
+        auto start = std::chrono::steady_clock::now();
+        emitter.Update(step.deltaTime);
+        result.updateSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        const ParticleStorage& particles = emitter.particles;
+        size_t deaths = liveBefore - particles.LiveCount();
+        bool sameCounts = deaths == step.deaths && emitter.LastCollisions() == step.collisions
+            && particles.LiveCount() == step.liveParticles;
+        if (!sameCounts)
+            ++result.countMismatchedSteps;
+        if (!sameCounts || ChecksumParticles(particles) != step.checksum) {
+            if (!mismatched)
+                result.firstMismatch = result.steps;
+            mismatched = true;
+            ++result.mismatchedSteps;
+        }
+
+        if (step.hasKeyframe) {
+            uint64_t size = 0;
+            file.read(reinterpret_cast<char*>(&size), sizeof(size));
+            bool read = ReadColumn(file, keyframe.positionX, size) && ReadColumn(file, keyframe.positionY, size)
+                && ReadColumn(file, keyframe.positionZ, size) && ReadColumn(file, keyframe.velocityX, size)
+                && ReadColumn(file, keyframe.velocityY, size) && ReadColumn(file, keyframe.velocityZ, size)
+                && ReadColumn(file, keyframe.color, size) && ReadColumn(file, keyframe.size, size)
+                && ReadColumn(file, keyframe.life, size);
+            if (!read)
+                break;
+
+            ++result.keyframes;
+            float error = std::numeric_limits<float>::infinity();
+            if (size == particles.Size() && keyframe.color == particles.color) {
+                error = 0.0f;
+                error = std::fmax(error, ColumnError(keyframe.positionX, particles.positionX));
+                error = std::fmax(error, ColumnError(keyframe.positionY, particles.positionY));
+                error = std::fmax(error, ColumnError(keyframe.positionZ, particles.positionZ));
+                error = std::fmax(error, ColumnError(keyframe.velocityX, particles.velocityX));
+                error = std::fmax(error, ColumnError(keyframe.velocityY, particles.velocityY));
+                error = std::fmax(error, ColumnError(keyframe.velocityZ, particles.velocityZ));
+                error = std::fmax(error, ColumnError(keyframe.size, particles.size));
+                error = std::fmax(error, ColumnError(keyframe.life, particles.life));
+            }
+            if (error > result.maxKeyframeError)
+                result.maxKeyframeError = error;
+        }
+
+        ++result.steps;
+    }
+
+    if (!mismatched)
+        result.firstMismatch = result.steps;
+    return result;
+}
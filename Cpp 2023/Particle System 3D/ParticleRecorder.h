@@ -0,0 +1,113 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+#include <glm/glm.hpp>
+#include "ParticleStorage.h"
+
+class ParticleEmitter;
+
+// Hash of every column of every slot, free ones included, so two states
+// compare bit for bit in one number.
+uint64_t ChecksumParticles(const ParticleStorage& particles);
+
+// Workload log of one emitter. The file is "PREC", a uint32 version and a
+// RecordingHeader followed by its colliders, then one record per Update():
+// a uint32 batch count and that many RecordedEmit, a RecordedStep and, on
+// keyframe steps, every column of the particle storage. Emits are recorded
+// with their position, so a replay does not need the generator or the input
+// that caused them. Colliders are recorded once, when the file is opened.
+struct RecordingHeader {
+    uint64_t seed;
+    uint32_t engine;
+    uint32_t deathPolicy;
+    uint32_t collisionMode;
+    uint32_t colliderCount;
+    uint32_t keyframeInterval;
+    uint32_t reserved;
+};
+
+struct RecordedEmit {
+    float x, y, z;
+    uint32_t count;
+};
+
+struct RecordedStep {
+    float deltaTime;
+    uint32_t hasKeyframe;
+    uint64_t deaths;
+    uint64_t collisions;
+    uint64_t liveParticles;
+    uint64_t checksum;
+};
+
+// Attach to ParticleEmitter::recorder. The emitter reports every emit batch
+// and every Update(); nothing is written between Open() and the first step.
+class ParticleRecorder {
+public:
+    static const uint32_t FILE_VERSION = 1;
+
+    // Steps between full snapshots, which replays compare within a
+    // tolerance; 0 records checksums only.
+    uint32_t keyframeInterval;
+
+    ParticleRecorder() : keyframeInterval(100), steps(0) {}
+
+    bool Open(const char* path, const ParticleEmitter& emitter);
+    void Close();
+    bool IsOpen() const { return file.is_open(); }
+
+    void RecordEmit(const glm::vec3& position, size_t count);
+    void RecordStep(const ParticleEmitter& emitter, float deltaTime, size_t deaths, size_t collisions);
+
+private:
+    std::ofstream file;
+    std::vector<RecordedEmit> pendingEmits;
+    uint64_t steps;
+};
+
+// Outcome of a replay. Counts and checksums are compared on every step,
+// particle columns on keyframe steps.
+struct ReplayResult {
+    bool opened;
+    uint64_t steps;
+    // Steps whose deaths, collisions, live count or checksum differed.
+    uint64_t mismatchedSteps;
+    // Of those, the steps whose deaths, collisions or live count differed,
+    // which no tolerance excuses.
+    uint64_t countMismatchedSteps;
+    // Index of the first such step, or steps if there was none.
+    uint64_t firstMismatch;
+    uint64_t keyframes;
+    // Largest absolute difference of any column on any keyframe.
+    float maxKeyframeError;
+    // Time spent in ParticleEmitter::Update() alone.
+    double updateSeconds;
+
+    // Exact when tolerance is 0. Otherwise every count must still match and
+    // at least one keyframe must have been compared, all within tolerance;
+    // only the checksums may drift.
+    bool Passed(float tolerance) const;
+};
+
+// Feeds a recording back through ParticleEmitter::Update(). The emitter's own
+// settings, such as its SIMD level, worker pool and collision mode, are kept,
+// which is what lets a variant be checked against a reference recording.
+class ParticleReplayer {
+public:
+    bool Open(const char* path);
+    const RecordingHeader& Header() const { return header; }
+
+    // Seeds the emitter, sets its death policy and colliders and clears its
+    // particles, as they were when the recording started.
+    void Prepare(ParticleEmitter& emitter) const;
+
+    // Replays every step. Prepare() the emitter first.
+    ReplayResult Run(ParticleEmitter& emitter);
+
+private:
+    std::ifstream file;
+    RecordingHeader header;
+    std::vector<SphereCollider> colliders;
+};
@@ -0,0 +1,152 @@
+#include "ParticleRenderBuffer.h"
+
+ParticleRenderBuffer::ParticleRenderBuffer()
+    : vao(0), vbo(0), quadVbo(0), capacityBytes(0), format(RenderVertexFormat::Float3), mapped(false), count(0), uploadedBytes(0) {}
+
+void ParticleRenderBuffer::Destroy() {
+    if (vbo != 0)
+        glDeleteBuffers(1, &vbo);
+    if (quadVbo != 0)
+        glDeleteBuffers(1, &quadVbo);
+    if (vao != 0)
+        glDeleteVertexArrays(1, &vao);
+    vao = 0;
+    vbo = 0;
+    quadVbo = 0;
+    capacityBytes = 0;
+    mapped = false;
+    count = 0;
+}
+
+void* ParticleRenderBuffer::Map(size_t maxCount, RenderVertexFormat vertexFormat) {
+    if (vao == 0) {
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        format = vertexFormat;
+        SetUpAttributes();
+    }
+    else if (vertexFormat != format) {
+        format = vertexFormat;
+        SetUpAttributes();
+    }
+
+    size_t bytes = maxCount * RenderVertexSize(format);
+    if (bytes == 0)
+        return nullptr;
+    if (bytes > capacityBytes)
+        Grow(bytes);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    // Invalidating the whole buffer orphans it: the driver hands back fresh
+    // storage while the GPU keeps drawing from the old one. Explicit flushing
+    // sends only the bytes actually written.
+    void* memory = glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
+    mapped = memory != nullptr;
+    if (!mapped)
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return memory;
+}
+
+void ParticleRenderBuffer::Unmap(size_t vertexCount) {
+    count = 0;
+    uploadedBytes = 0;
+    if (!mapped)
+        return;
+    mapped = false;
+
+    size_t bytes = vertexCount * RenderVertexSize(format);
+    if (bytes != 0)
+        glFlushMappedBufferRange(GL_ARRAY_BUFFER, 0, bytes);
+    // GL_FALSE means the storage was lost while mapped; skip this frame.
+    if (glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE) {
+        count = vertexCount;
+        uploadedBytes = bytes;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ParticleRenderBuffer::Draw(GLenum mode) const {
+    if (count == 0)
+        return;
+
+    glBindVertexArray(vao);
+    if (IsBillboardFormat(format))
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(count));
+    else
+        glDrawArrays(mode, 0, static_cast<GLsizei>(count));
+    glBindVertexArray(0);
+}
+
+void ParticleRenderBuffer::Grow(size_t requiredBytes) {
+    size_t newCapacity = capacityBytes < MIN_CAPACITY_BYTES ? MIN_CAPACITY_BYTES : capacityBytes;
+    while (newCapacity < requiredBytes)
+        newCapacity *= 2;
+    capacityBytes = newCapacity;
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, capacityBytes, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Point formats: position at location 0, color at location 1 as normalized
+// RGBA8, both interleaved in one stream. Billboards: the static quad corner
+// at location 0, then per instance the position and size at location 1 and
+// the color at location 2.
+void ParticleRenderBuffer::SetUpAttributes() {
+    glBindVertexArray(vao);
+
+    if (IsBillboardFormat(format)) {
+        if (quadVbo == 0) {
+            // Corners of a unit quad as a triangle strip.
+            const float corners[] = { -0.5f, -0.5f, 0.5f, -0.5f, -0.5f, 0.5f, 0.5f, 0.5f };
+            glGenBuffers(1, &quadVbo);
+            glBindBuffer(GL_ARRAY_BUFFER, quadVbo);
+            glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, quadVbo);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+        glVertexAttribDivisor(0, 0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        if (format == RenderVertexFormat::BillboardHalf) {
+            GLsizei stride = sizeof(RenderVertexBillboardHalf);
+            glVertexAttribPointer(1, 4, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(RenderVertexBillboardHalf, x));
+            glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+                (void*)offsetof(RenderVertexBillboardHalf, color));
+        }
+        else {
+            GLsizei stride = sizeof(RenderVertexBillboard);
+            glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(RenderVertexBillboard, x));
+            glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)offsetof(RenderVertexBillboard, color));
+        }
+        glVertexAttribDivisor(1, 1);
+        glVertexAttribDivisor(2, 1);
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glVertexAttribDivisor(1, 0);
+    glDisableVertexAttribArray(2);
+    if (format == RenderVertexFormat::Half3) {
+        GLsizei stride = sizeof(RenderVertexHalf3);
+        glVertexAttribPointer(0, 4, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(RenderVertexHalf3, x));
+        glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)offsetof(RenderVertexHalf3, color));
+    }
+    else {
+        GLsizei stride = sizeof(RenderVertexFloat3);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(RenderVertexFloat3, x));
+        glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)offsetof(RenderVertexFloat3, color));
+    }
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+#include "RenderVertex.h"
+
+// Vertex buffer for packed particle vertices that lives as long as the
+// renderer. It is created on first use, grows geometrically, and invalidates
+// its storage on every map, so the CPU never waits for the GPU to stop
+// reading the previous frame.
+class ParticleRenderBuffer {
+public:
+    ParticleRenderBuffer();
+
+    ParticleRenderBuffer(const ParticleRenderBuffer&) = delete;
+    ParticleRenderBuffer& operator=(const ParticleRenderBuffer&) = delete;
+
+    // Needs a current GL context; the buffer can be reused afterwards.
+    void Destroy();
+
+    // Returns write-only memory for up to maxCount vertices, or null when
+    // there is nothing to write. Every Map() must be followed by Unmap().
+    void* Map(size_t maxCount, RenderVertexFormat format);
+    // Uploads the first count vertices written since Map().
+    void Unmap(size_t count);
+    // Billboards are always drawn as one instanced quad per vertex, so mode
+    // only applies to the point formats.
+    void Draw(GLenum mode) const;
+
+    size_t CapacityBytes() const { return capacityBytes; }
+    // Bytes sent by the last Unmap().
+    size_t UploadedBytes() const { return uploadedBytes; }
+
+private:
+    static const size_t MIN_CAPACITY_BYTES = 16 * 1024;
+
+    GLuint vao;
+    GLuint vbo;
+    // Static quad shared by all billboard instances, created on first use.
+    GLuint quadVbo;
+    size_t capacityBytes;
+    RenderVertexFormat format;
+    bool mapped;
+    size_t count;
+    size_t uploadedBytes;
+
+    void Grow(size_t requiredBytes);
+    void SetUpAttributes();
+};
@@ -0,0 +1,216 @@
+#include "ParticleRenderer.h"
+#include <chrono>
+#include <glm/gtc/type_ptr.hpp>
+
+// The quad corner is offset in view space, so the billboard always faces the
+// camera and its size is in world units.
+static const char* billboardVertexShaderSource = R"(
+    #version 330 core
+    layout (location = 0) in vec2 aCorner;
+    layout (location = 1) in vec4 aPositionSize;
+    layout (location = 2) in vec4 aColor;
+    uniform mat4 view;
+    uniform mat4 projection;
+    out vec2 corner;
+    out vec4 color;
+    void main() {
+        vec4 center = view * vec4(aPositionSize.xyz, 1.0);
+        center.xy += aCorner * aPositionSize.w;
+        gl_Position = projection * center;
+        corner = aCorner;
+        color = aColor;
+    }
+)";
+
+// Round particles with a soft edge.
+static const char* billboardFragmentShaderSource = R"(
+    #version 330 core
+    in vec2 corner;
+    in vec4 color;
+    out vec4 FragColor;
+    void main() {
+        float distanceSquared = dot(corner, corner) * 4.0;
+        if (distanceSquared > 1.0)
+            discard;
+        FragColor = vec4(color.rgb, color.a * (1.0 - distanceSquared));
+    }
+)";
+
+// The point formats: half positions come with w = 1, float ones get it.
+static const char* blendedVertexShaderSource = R"(
+    #version 330 core
+    layout (location = 0) in vec3 aPos;
+    layout (location = 1) in vec4 aColor;
+    uniform mat4 view;
+    uniform mat4 projection;
+    out vec4 color;
+    void main() {
+        gl_Position = projection * view * vec4(aPos, 1.0);
+        color = aColor;
+    }
+)";
+
+// The billboard's soft round edge, on a point sprite.
+static const char* blendedFragmentShaderSource = R"(
+    #version 330 core
+    in vec4 color;
+    out vec4 FragColor;
+    void main() {
+        vec2 corner = gl_PointCoord - 0.5;
+        float distanceSquared = dot(corner, corner) * 4.0;
+        if (distanceSquared > 1.0)
+            discard;
+        FragColor = vec4(color.rgb, color.a * (1.0 - distanceSquared));
+    }
+)";
+
+void ParticleRenderer::Render(const ParticleEmitter& emitter, const glm::mat4& view, const glm::mat4& projection,
+    float lookahead) {
+    Render(emitter.particles, view, projection, lookahead);
+}
+
+void ParticleRenderer::Render(const ParticleStorage& particles, const glm::mat4& view, const glm::mat4& projection,
+    float lookahead) {
+    Prepare(particles, view, projection, lookahead);
+    if (Map())
+        PackRange(0, PackCount());
+    Draw(view, projection);
+}
+
+void ParticleRenderer::Prepare(const ParticleStorage& particles, const glm::mat4& view, const glm::mat4& projection,
+    float lookahead) {
+    bool sorting = depthSort && mode != ParticleRenderMode::Points;
+    prepared = &particles;
+    packLookahead = lookahead;
+    if (mode == ParticleRenderMode::Billboards)
+        packFormat = vertexFormat == RenderVertexFormat::Half3 ? RenderVertexFormat::BillboardHalf
+                                                               : RenderVertexFormat::Billboard;
+    else
+        packFormat = vertexFormat;
+
+    // The packer is handed a list of slots unless every slot is live and
+    // drawn in order; slot ranges only pack in parallel without free slots.
+    bool gaps = particles.LiveCount() != particles.Size();
+    packList = nullptr;
+    if (culling || sorting || gaps) {
+        if (visibleIndices.size() < particles.Size())
+            visibleIndices.resize(particles.Size());
+    }
+    if (culling) {
+        // Culled first, so the buffer is only mapped for what is visible.
+        lastCull = CullParticles(DetectSimdLevel(), particles.Span(), lookahead,
+            ExtractFrustum(projection, view, cullDistance), cullMargin, visibleIndices.data());
+        // With nothing culled, packing every slot in order beats going
+        // through the list.
+        if (lastCull.visible != lastCull.live || gaps)
+            packList = visibleIndices.data();
+    }
+    else {
+        lastCull.live = particles.LiveCount();
+        lastCull.visible = lastCull.live;
+        if (sorting || gaps) {
+            size_t live = 0;
+            for (size_t i = 0; i < particles.Size(); ++i) {
+                if (particles.IsAlive(i))
+                    visibleIndices[live++] = static_cast<uint32_t>(i);
+            }
+            packList = visibleIndices.data();
+        }
+    }
+
+    lastSort = DepthSortResult();
+    if (sorting) {
+        auto sortStart = std::chrono::steady_clock::now();
+        depthSorter.workerPool = workerPool;
+        lastSort = depthSorter.Sort(particles.Span(), visibleIndices.data(), lastCull.visible, lookahead, view);
+        packList = depthSorter.Order();
+        if (stats != nullptr) {
+            stats->AddSortTime(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - sortStart).count()), lastSort.reusedOrder, lastSort.incremental);
+        }
+    }
+}
+
+bool ParticleRenderer::Map() {
+    mappedVertices = renderBuffer.Map(PackCount(), packFormat);
+    return mappedVertices != nullptr;
+}
+
+void ParticleRenderer::PackRange(size_t begin, size_t end) {
+    if (mappedVertices == nullptr)
+        return;
+    void* out = static_cast<unsigned char*>(mappedVertices) + begin * RenderVertexSize(packFormat);
+    if (packList != nullptr)
+        PackRenderVertices(*prepared, packList + begin, end - begin, packLookahead, fadeTime, packFormat, out);
+    else
+        PackRenderVertices(*prepared, begin, end, packLookahead, fadeTime, packFormat, out);
+}
+
+void ParticleRenderer::Draw(const glm::mat4& view, const glm::mat4& projection) {
+    // Every range of PackCount() writes exactly its own vertices.
+    renderBuffer.Unmap(mappedVertices != nullptr ? PackCount() : 0);
+    mappedVertices = nullptr;
+
+    if (stats != nullptr) {
+        stats->AddUploadBytes(renderBuffer.UploadedBytes());
+        stats->AddCulling(lastCull.live, lastCull.visible);
+    }
+
+    if (mode != ParticleRenderMode::Points) {
+        DrawBlended(view, projection);
+        return;
+    }
+
+    glPointSize(5.0f);
+    renderBuffer.Draw(GL_POINTS);
+}
+
+void ParticleRenderer::Destroy() {
+    renderBuffer.Destroy();
+    ownShaders.Destroy();
+    billboardProgram = 0;
+    blendedProgram = 0;
+}
+
+// Blended without depth writes, so overlapping soft edges do not cut holes
+// into each other. The blend and depth state are restored afterwards, but
+// the renderer's program stays bound: asking GL for the caller's would stall
+// on the driver every frame, so the caller rebinds its own.
+void ParticleRenderer::DrawBlended(const glm::mat4& view, const glm::mat4& projection) {
+    bool billboards = mode == ParticleRenderMode::Billboards;
+    GLuint program = billboards ? billboardProgram : blendedProgram;
+    // Never built here: a failed build would be retried, and logged, every
+    // frame.
+    if (program == 0)
+        return;
+
+    glUseProgram(program);
+    glUniformMatrix4fv(billboards ? billboardViewLocation : blendedViewLocation, 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(billboards ? billboardProjectionLocation : blendedProjectionLocation, 1, GL_FALSE,
+        glm::value_ptr(projection));
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+    if (billboards) {
+        renderBuffer.Draw(GL_TRIANGLE_STRIP);
+    }
+    else {
+        glPointSize(5.0f);
+        renderBuffer.Draw(GL_POINTS);
+    }
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+}
+
+bool ParticleRenderer::BuildPrograms() {
+    ShaderManager& manager = shaders != nullptr ? *shaders : ownShaders;
+    billboardProgram = manager.Build("billboard", billboardVertexShaderSource, billboardFragmentShaderSource);
+    billboardViewLocation = manager.UniformLocation(billboardProgram, "view");
+    billboardProjectionLocation = manager.UniformLocation(billboardProgram, "projection");
+
+    blendedProgram = manager.Build("blended_point", blendedVertexShaderSource, blendedFragmentShaderSource);
+    blendedViewLocation = manager.UniformLocation(blendedProgram, "view");
+    blendedProjectionLocation = manager.UniformLocation(blendedProgram, "projection");
+    return billboardProgram != 0 && blendedProgram != 0;
+}
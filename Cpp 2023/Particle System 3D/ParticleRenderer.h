@@ -0,0 +1,124 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "DepthSorter.h"
+#include "ParticleEmitter.h"
+#include "ParticleRenderBuffer.h"
+#include "ParticleStats.h"
+#include "RenderVertex.h"
+#include "ShaderManager.h"
+
+enum class ParticleRenderMode {
+    // One GL_POINTS vertex per particle, drawn with the caller's program at
+    // a fixed point size.
+    Points,
+    // One camera-facing quad per particle, sized per particle and faded out
+    // over the end of its life, all in a single instanced draw.
+    Billboards,
+    // Like Points, but drawn with the renderer's own program as soft round
+    // points in each particle's color, alpha blended.
+    BlendedPoints
+};
+
+// Packs live particles into the render buffer and draws them.
+class ParticleRenderer {
+public:
+    ParticleRenderMode mode;
+    // Float3 or Half3: position precision on upload. Billboards use the
+    // matching billboard layout. Half3 is lossy, about 0.002-0.004 at 1-4
+    // units from the origin, so it is opt-in.
+    RenderVertexFormat vertexFormat;
+    // Seconds before death over which a particle's alpha fades to zero.
+    float fadeTime;
+    // When set, receives the bytes uploaded and the share culled per frame.
+    ParticleStats* stats;
+    // Packs only particles inside the view frustum.
+    bool culling;
+    // How far past its center a particle may still show, in world units.
+    // Covers the largest billboard.
+    float cullMargin;
+    // Above 0, also culls particles further than this from the eye along
+    // the view direction.
+    float cullDistance;
+    // Packs the blended modes back to front, so near particles are blended
+    // over far ones rather than in slot order.
+    bool depthSort;
+    // Shared with the depth sort; null sorts on the calling thread.
+    WorkerPool* workerPool;
+    // Builds and owns the blended modes' programs; null builds them with a
+    // manager of the renderer's own, without a binary cache.
+    ShaderManager* shaders;
+
+    ParticleRenderer()
+        : mode(ParticleRenderMode::Points), vertexFormat(RenderVertexFormat::Float3), fadeTime(1.0f),
+          stats(nullptr), culling(true), cullMargin(0.02f), cullDistance(0.0f), depthSort(true),
+          workerPool(nullptr), shaders(nullptr), prepared(nullptr), packList(nullptr), packLookahead(0.0f),
+          packFormat(RenderVertexFormat::Float3), mappedVertices(nullptr), billboardProgram(0),
+          billboardViewLocation(-1), billboardProjectionLocation(-1), blendedProgram(0), blendedViewLocation(-1), blendedProjectionLocation(-1) {}
+
+    // lookahead is the simulated time that has passed since the emitter's last
+    // step; positions are moved along their velocity by that much, so motion
+    // stays smooth when frames fall between fixed steps. The point path draws
+    // with the current program and ignores view and projection; the blended
+    // modes leave their own program bound.
+    void Render(const ParticleEmitter& emitter, const glm::mat4& view, const glm::mat4& projection,
+        float lookahead = 0.0f);
+    // Draws any storage whose live slots are particles, such as the shared
+    // storage of a ParticleSystem, in one upload and one draw call.
+    void Render(const ParticleStorage& particles, const glm::mat4& view, const glm::mat4& projection,
+        float lookahead = 0.0f);
+
+    // Render() in stages, for callers that run the CPU side as jobs.
+    // Prepare() culls and sorts, Map() maps the buffer for PackCount()
+    // vertices, PackRange() writes vertices [begin, end) and may run on any
+    // thread for disjoint ranges, and Draw() uploads and draws. Map() and
+    // Draw() make GL calls, so they belong to the context's thread; the
+    // particles must not change from Prepare() until the packing is done.
+    void Prepare(const ParticleStorage& particles, const glm::mat4& view, const glm::mat4& projection,
+        float lookahead = 0.0f);
+    bool Map();
+    size_t PackCount() const { return packList != nullptr ? lastCull.visible : prepared->Size(); }
+    void PackRange(size_t begin, size_t end);
+    void Draw(const glm::mat4& view, const glm::mat4& projection);
+
+    // Builds the blended modes' programs; call once at startup, before
+    // drawing in either mode. False when either failed to build, after its
+    // log was printed; the blended modes then draw nothing.
+    bool BuildPrograms();
+
+    // Frees the GL objects, except programs of a shared ShaderManager; call
+    // while the context is still current.
+    void Destroy();
+
+    // Outcome of the last Render()'s culling; without culling every live
+    // particle counts as visible.
+    const CullResult& LastCull() const { return lastCull; }
+    // Outcome of the last Render()'s depth sort; count is 0 when it did not
+    // sort.
+    const DepthSortResult& LastSort() const { return lastSort; }
+
+private:
+    ParticleRenderBuffer renderBuffer;
+    // Indices of the visible particles, reused from frame to frame.
+    std::vector<uint32_t> visibleIndices;
+    CullResult lastCull;
+    DepthSorter depthSorter;
+    DepthSortResult lastSort;
+    // What Prepare() chose for the packing stages. A null list packs every
+    // slot, which Prepare() only allows when none is free.
+    const ParticleStorage* prepared;
+    const uint32_t* packList;
+    float packLookahead;
+    RenderVertexFormat packFormat;
+    void* mappedVertices;
+    ShaderManager ownShaders;
+    GLuint billboardProgram;
+    GLint billboardViewLocation;
+    GLint billboardProjectionLocation;
+    GLuint blendedProgram;
+    GLint blendedViewLocation;
+    GLint blendedProjectionLocation;
+
+    void DrawBlended(const glm::mat4& view, const glm::mat4& projection);
+};
@@ -0,0 +1,257 @@
+#include "ParticleSnapshot.h"
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include "ParticleEmitter.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    uint64_t AlignBlock(uint64_t offset) {
+        return (offset + SNAPSHOT_BLOCK_ALIGNMENT - 1) / SNAPSHOT_BLOCK_ALIGNMENT * SNAPSHOT_BLOCK_ALIGNMENT;
+    }
+
+    void WriteBlock(std::ofstream& file, uint64_t& written, uint64_t offset, const void* block, size_t bytes) {
+        static const char padding[SNAPSHOT_BLOCK_ALIGNMENT] = {};
+        file.write(padding, static_cast<std::streamsize>(offset - written));
+        file.write(static_cast<const char*>(block), static_cast<std::streamsize>(bytes));
+        written = offset + bytes;
+    }
+
+    const void* ColumnData(const ParticleStorage& particles, size_t column) {
+        switch (column) {
+        case SNAPSHOT_POSITION_X: return particles.positionX.data();
+        case SNAPSHOT_POSITION_Y: return particles.positionY.data();
+        case SNAPSHOT_POSITION_Z: return particles.positionZ.data();
+        case SNAPSHOT_VELOCITY_X: return particles.velocityX.data();
+        case SNAPSHOT_VELOCITY_Y: return particles.velocityY.data();
+        case SNAPSHOT_VELOCITY_Z: return particles.velocityZ.data();
+        case SNAPSHOT_COLOR: return particles.color.data();
+        case SNAPSHOT_SIZE: return particles.size.data();
+        default: return particles.life.data();
+        }
+    }
+
+    void* ColumnData(ParticleStorage& particles, size_t column) {
+        return const_cast<void*>(ColumnData(static_cast<const ParticleStorage&>(particles), column));
+    }
+}
+
+ParticleSnapshot::ParticleSnapshot() : data(nullptr), mappedSize(0) {
+#ifdef _WIN32
+    fileHandle = INVALID_HANDLE_VALUE;
+    mappingHandle = nullptr;
+#endif
+}
+
+ParticleSnapshot::~ParticleSnapshot() {
+    Unmap();
+}
+
+// Every column is 32 bits per slot, so the layout only depends on the counts.
+bool ParticleSnapshot::Save(const char* path, const ParticleEmitter& emitter) {
+    const ParticleStorage& particles = emitter.particles;
+    const std::vector<size_t>& freeSlots = particles.FreeSlots();
+    size_t columnBytes = particles.Size() * sizeof(float);
+
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "PSNP", 4);
+    header.version = FILE_VERSION;
+    header.headerSize = sizeof(SnapshotHeader);
+    header.blockAlignment = SNAPSHOT_BLOCK_ALIGNMENT;
+    header.slotCount = particles.Size();
+    header.freeSlotCount = freeSlots.size();
+    header.colliderCount = emitter.colliders.size();
+    header.seed = emitter.EmitSeed();
+    header.engine = static_cast<uint32_t>(emitter.EmitEngine());
+    header.deathPolicy = static_cast<uint32_t>(particles.deathPolicy);
+    header.collisionMode = static_cast<uint32_t>(emitter.collisionMode);
+    header.position[0] = emitter.position.x;
+    header.position[1] = emitter.position.y;
+    header.position[2] = emitter.position.z;
+
+    uint64_t offset = AlignBlock(sizeof(SnapshotHeader));
+    for (size_t column = 0; column < SNAPSHOT_COLUMN_COUNT; ++column) {
+        header.columnOffset[column] = offset;
+        offset = AlignBlock(offset + columnBytes);
+    }
+    header.freeSlotOffset = offset;
+    offset = AlignBlock(offset + freeSlots.size() * sizeof(uint64_t));
+    header.colliderOffset = offset;
+    header.fileSize = offset + emitter.colliders.size() * sizeof(SphereCollider);
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    uint64_t written = 0;
+    WriteBlock(file, written, 0, &header, sizeof(header));
+    for (size_t column = 0; column < SNAPSHOT_COLUMN_COUNT; ++column)
+        WriteBlock(file, written, header.columnOffset[column], ColumnData(particles, column), columnBytes);
+
+    std::vector<uint64_t> slots(freeSlots.begin(), freeSlots.end());
+    WriteBlock(file, written, header.freeSlotOffset, slots.data(), slots.size() * sizeof(uint64_t));
+    WriteBlock(file, written, header.colliderOffset, emitter.colliders.data(),
+        emitter.colliders.size() * sizeof(SphereCollider));
+    file.close();
+    return static_cast<bool>(file);
+}
+
+bool ParticleSnapshot::Map(const char* path) {
+    Unmap();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    fileHandle = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || static_cast<uint64_t>(size.QuadPart) < sizeof(SnapshotHeader)) {
+        Unmap();
+        return false;
+    }
+    mappingHandle = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    if (mappingHandle == nullptr) {
+        Unmap();
+        return false;
+    }
+    data = static_cast<unsigned char*>(MapViewOfFile(mappingHandle, FILE_MAP_COPY, 0, 0, 0));
+    mappedSize = static_cast<size_t>(size.QuadPart);
+#else
+    int file = open(path, O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat status;
+    if (fstat(file, &status) != 0 || static_cast<uint64_t>(status.st_size) < sizeof(SnapshotHeader)) {
+        close(file);
+        return false;
+    }
+    mappedSize = static_cast<size_t>(status.st_size);
+    // The mapping keeps its own reference to the file.
+    void* mapped = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    close(file);
+    data = mapped == MAP_FAILED ? nullptr : static_cast<unsigned char*>(mapped);
+#endif
+
+    if (data == nullptr || !Validate()) {
+        Unmap();
+        return false;
+    }
+    return true;
+}
+
+void ParticleSnapshot::Unmap() {
+#ifdef _WIN32
+    if (data != nullptr)
+        UnmapViewOfFile(data);
+    if (mappingHandle != nullptr)
+        CloseHandle(mappingHandle);
+    if (fileHandle != INVALID_HANDLE_VALUE)
+        CloseHandle(fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = INVALID_HANDLE_VALUE;
+#else
+    if (data != nullptr)
+        munmap(data, mappedSize);
+#endif
+    data = nullptr;
+    mappedSize = 0;
+}
+
+// Only the header and the free-slot list are read; a block that lies inside
+// the file is trusted. Free slots are indices the emitter will write
+// through, so each must name a slot of the snapshot.
+bool ParticleSnapshot::Validate() const {
+    const SnapshotHeader& header = Header();
+    if (std::memcmp(header.magic, "PSNP", 4) != 0 || header.version != FILE_VERSION
+        || header.headerSize != sizeof(SnapshotHeader) || header.fileSize != mappedSize)
+        return false;
+
+    uint64_t size = mappedSize;
+    auto inside = [size](uint64_t offset, uint64_t count, uint64_t elementSize) {
+        return offset % CACHE_LINE_SIZE == 0 && offset <= size && count <= (size - offset) / elementSize;
+    };
+    for (size_t column = 0; column < SNAPSHOT_COLUMN_COUNT; ++column) {
+        if (!inside(header.columnOffset[column], header.slotCount, sizeof(float)))
+            return false;
+    }
+    if (!inside(header.freeSlotOffset, header.freeSlotCount, sizeof(uint64_t))
+        || header.freeSlotCount > header.slotCount)
+        return false;
+    const uint64_t* freeSlots = FreeSlots();
+    for (uint64_t i = 0; i < header.freeSlotCount; ++i) {
+        if (freeSlots[i] >= header.slotCount)
+            return false;
+    }
+    return inside(header.colliderOffset, header.colliderCount, sizeof(SphereCollider))
+        && header.deathPolicy <= static_cast<uint32_t>(DeathPolicy::FreeList)
+        && header.collisionMode <= static_cast<uint32_t>(CollisionMode::Grid)
+        && header.engine <= static_cast<uint32_t>(RandomEngine::CounterHash);
+}
+
+const float* ParticleSnapshot::Column(SnapshotColumn column) const {
+    return reinterpret_cast<const float*>(data + Header().columnOffset[column]);
+}
+
+const uint32_t* ParticleSnapshot::Color() const {
+    return reinterpret_cast<const uint32_t*>(data + Header().columnOffset[SNAPSHOT_COLOR]);
+}
+
+const uint64_t* ParticleSnapshot::FreeSlots() const {
+    return reinterpret_cast<const uint64_t*>(data + Header().freeSlotOffset);
+}
+
+const SphereCollider* ParticleSnapshot::Colliders() const {
+    return reinterpret_cast<const SphereCollider*>(data + Header().colliderOffset);
+}
+
+ParticleSpan ParticleSnapshot::Span() {
+    const SnapshotHeader& header = Header();
+    ParticleSpan span;
+    span.positionX = reinterpret_cast<float*>(data + header.columnOffset[SNAPSHOT_POSITION_X]);
+    span.positionY = reinterpret_cast<float*>(data + header.columnOffset[SNAPSHOT_POSITION_Y]);
+    span.positionZ = reinterpret_cast<float*>(data + header.columnOffset[SNAPSHOT_POSITION_Z]);
+    span.velocityX = reinterpret_cast<float*>(data + header.columnOffset[SNAPSHOT_VELOCITY_X]);
+    span.velocityY = reinterpret_cast<float*>(data + header.columnOffset[SNAPSHOT_VELOCITY_Y]);
+    span.velocityZ = reinterpret_cast<float*>(data + header.columnOffset[SNAPSHOT_VELOCITY_Z]);
+    span.life = reinterpret_cast<float*>(data + header.columnOffset[SNAPSHOT_LIFE]);
+    span.count = Size();
+    return span;
+}
+
+void ParticleSnapshot::Restore(ParticleEmitter& emitter) const {
+    const SnapshotHeader& header = Header();
+    ParticleStorage& particles = emitter.particles;
+    size_t count = Size();
+
+    particles.Clear();
+    particles.deathPolicy = static_cast<DeathPolicy>(header.deathPolicy);
+    particles.Append(count);
+
+    auto copyColumns = [&](size_t begin, size_t end) {
+        for (size_t column = begin; column < end; ++column)
+            std::memcpy(ColumnData(particles, column), data + header.columnOffset[column], count * sizeof(float));
+    };
+    if (emitter.workerPool != nullptr)
+        emitter.workerPool->ParallelFor(SNAPSHOT_COLUMN_COUNT, 1, copyColumns);
+    else
+        copyColumns(0, SNAPSHOT_COLUMN_COUNT);
+
+    particles.AssignFreeSlots(FreeSlots(), static_cast<size_t>(header.freeSlotCount));
+    emitter.colliders.assign(Colliders(), Colliders() + header.colliderCount);
+    emitter.collisionMode = static_cast<CollisionMode>(header.collisionMode);
+    emitter.position = glm::vec3(header.position[0], header.position[1], header.position[2]);
+    emitter.Seed(header.seed, static_cast<RandomEngine>(header.engine));
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "ParticleStorage.h"
+#include "ParticleKernels.h"
+
+class ParticleEmitter;
+
+enum SnapshotColumn {
+    SNAPSHOT_POSITION_X,
+    SNAPSHOT_POSITION_Y,
+    SNAPSHOT_POSITION_Z,
+    SNAPSHOT_VELOCITY_X,
+    SNAPSHOT_VELOCITY_Y,
+    SNAPSHOT_VELOCITY_Z,
+    SNAPSHOT_COLOR,
+    SNAPSHOT_SIZE,
+    SNAPSHOT_LIFE,
+    SNAPSHOT_COLUMN_COUNT
+};
+
+// First bytes of a snapshot file. Every block after it (the particle columns,
+// the free slot list and the colliders) starts at a multiple of
+// SNAPSHOT_BLOCK_ALIGNMENT, so a mapped file hands out page-aligned columns
+// that the kernels can run on as they are. Values are in the writer's byte
+// order; a file from the other endianness is rejected, not converted.
+struct SnapshotHeader {
+    char magic[4];
+    uint32_t version;
+    // sizeof(SnapshotHeader) of the writer, so a later version can grow it.
+    uint32_t headerSize;
+    uint32_t blockAlignment;
+    uint64_t slotCount;
+    uint64_t freeSlotCount;
+    uint64_t colliderCount;
+    uint64_t seed;
+    uint32_t engine;
+    uint32_t deathPolicy;
+    uint32_t collisionMode;
+    uint32_t reserved;
+    float position[3];
+    float reserved2;
+    uint64_t columnOffset[SNAPSHOT_COLUMN_COUNT];
+    // Free slots are uint64 indices, colliders are SphereCollider.
+    uint64_t freeSlotOffset;
+    uint64_t colliderOffset;
+    uint64_t fileSize;
+};
+
+const size_t SNAPSHOT_BLOCK_ALIGNMENT = 4096;
+
+// Read-only view of a snapshot file mapped into memory. Map() checks the
+// header, the block bounds and the free-slot indices and nothing else: no
+// particle is read until it is used. The mapping is copy-on-write, so
+// Span() can be simulated in place without touching the file.
+class ParticleSnapshot {
+public:
+    static const uint32_t FILE_VERSION = 1;
+
+    ParticleSnapshot();
+    ~ParticleSnapshot();
+
+    ParticleSnapshot(const ParticleSnapshot&) = delete;
+    ParticleSnapshot& operator=(const ParticleSnapshot&) = delete;
+
+    // Writes the emitter's particles, colliders, position, seed and death
+    // policy.
+    static bool Save(const char* path, const ParticleEmitter& emitter);
+
+    bool Map(const char* path);
+    void Unmap();
+    bool IsMapped() const { return data != nullptr; }
+
+    const SnapshotHeader& Header() const { return *reinterpret_cast<const SnapshotHeader*>(data); }
+    size_t Size() const { return static_cast<size_t>(Header().slotCount); }
+
+    const float* Column(SnapshotColumn column) const;
+    const uint32_t* Color() const;
+    const uint64_t* FreeSlots() const;
+    const SphereCollider* Colliders() const;
+
+    // Every slot of the mapping, free ones included, as the kernels take it.
+    // Writes go to private copies of the touched pages.
+    ParticleSpan Span();
+
+    // Copies the snapshot into the emitter column by column, one column per
+    // job when the emitter has a worker pool. The emitter is reseeded with
+    // the saved seed, so particles emitted afterwards restart its sequence
+    // rather than continue it.
+    void Restore(ParticleEmitter& emitter) const;
+
+private:
+    unsigned char* data;
+    size_t mappedSize;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+
+    bool Validate() const;
+};
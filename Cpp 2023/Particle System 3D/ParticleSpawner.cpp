@@ -0,0 +1,92 @@
+#include "ParticleSpawner.h"
+
+void ParticleSpawner::Seed(uint64_t seed, RandomEngine engine) {
+    for (size_t i = 0; i < STREAM_COUNT; ++i)
+        streams[i] = RandomStream(seed, i, engine);
+}
+
+// Every random attribute draws from its own stream, so the columns can be
+// filled in any order, or in parallel, and still come out the same.
+void ParticleSpawner::Fill(ParticleStorage& particles, size_t begin, size_t count, glm::vec3 origin,
+    SimdLevel simdLevel, WorkerPool* workerPool) {
+    const float life = Particle().life;
+
+    auto fillColumn = [&](size_t column) {
+        if (column < STREAM_COUNT)
+            streams[column].simdLevel = simdLevel;
+
+        switch (column) {
+        case STREAM_VELOCITY_X:
+            streams[column].FillUniform(particles.velocityX.data() + begin, count, -0.5f, 0.5f);
+            break;
+        case STREAM_VELOCITY_Y:
+            streams[column].FillUniform(particles.velocityY.data() + begin, count, -0.5f, 0.5f);
+            break;
+        case STREAM_VELOCITY_Z:
+            streams[column].FillUniform(particles.velocityZ.data() + begin, count, -0.5f, 0.5f);
+            break;
+        case STREAM_SIZE:
+            streams[column].FillUniform(particles.size.data() + begin, count, 0.005f, 0.015f);
+            break;
+        case STREAM_COLOR: {
+            uint32_t* color = particles.color.data() + begin;
+            streams[column].FillBits(color, count);
+            for (size_t i = 0; i < count; ++i)
+                color[i] |= 0xff000000u;
+            break;
+        }
+        default: {
+            float* positionX = particles.positionX.data() + begin;
+            float* positionY = particles.positionY.data() + begin;
+            float* positionZ = particles.positionZ.data() + begin;
+            float* lives = particles.life.data() + begin;
+            for (size_t i = 0; i < count; ++i) {
+                positionX[i] = origin.x;
+                positionY[i] = origin.y;
+                positionZ[i] = origin.z;
+                lives[i] = life;
+            }
+            break;
+        }
+        }
+    };
+
+    // One job per stream plus one for the fixed columns.
+    const size_t columnJobs = STREAM_COUNT + 1;
+    if (workerPool != nullptr && count >= PARALLEL_MIN_PARTICLES) {
+        workerPool->ParallelFor(columnJobs, 1, [&](size_t chunkBegin, size_t chunkEnd) {
+            for (size_t column = chunkBegin; column < chunkEnd; ++column)
+                fillColumn(column);
+        });
+    }
+    else {
+        for (size_t column = 0; column < columnJobs; ++column)
+            fillColumn(column);
+    }
+}
+
+void ParticleSpawner::FillFreeSlots(ParticleStorage& particles, size_t count, glm::vec3 origin, SimdLevel simdLevel) {
+    if (batch.Size() < FREE_SLOT_BATCH)
+        batch.Append(FREE_SLOT_BATCH - batch.Size());
+
+    size_t slots[FREE_SLOT_BATCH];
+    while (count > 0) {
+        size_t n = count < FREE_SLOT_BATCH ? count : FREE_SLOT_BATCH;
+        Fill(batch, 0, n, origin, simdLevel, nullptr);
+        for (size_t k = 0; k < n; ++k)
+            slots[k] = particles.PopFreeSlot();
+        for (size_t k = 0; k < n; ++k) {
+            size_t slot = slots[k];
+            particles.positionX[slot] = batch.positionX[k];
+            particles.positionY[slot] = batch.positionY[k];
+            particles.positionZ[slot] = batch.positionZ[k];
+            particles.velocityX[slot] = batch.velocityX[k];
+            particles.velocityY[slot] = batch.velocityY[k];
+            particles.velocityZ[slot] = batch.velocityZ[k];
+            particles.color[slot] = batch.color[k];
+            particles.size[slot] = batch.size[k];
+            particles.life[slot] = batch.life[k];
+        }
+        count -= n;
+    }
+}
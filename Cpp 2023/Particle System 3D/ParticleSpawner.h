@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "ParticleStorage.h"
+#include "ParticleKernels.h"
+#include "Random.h"
+#include "WorkerPool.h"
+
+// The random streams behind emission and the code that fills new particles
+// from them. ParticleEmitter has one, and so does every emitter of a
+// ParticleSystem, which fills its own segment of the shared storage.
+class ParticleSpawner {
+public:
+    // Each random attribute draws from its own stream of the seed.
+    void Seed(uint64_t seed, RandomEngine engine);
+
+    // Fills every column of particles [begin, begin + count): the origin as
+    // position, velocity components in [-0.5, 0.5), opaque random colors,
+    // sizes in [0.005, 0.015) and a fresh life. With a worker pool, columns
+    // of at least PARALLEL_MIN_PARTICLES are filled in parallel; the result
+    // is the same either way. origin is taken by value so the column stores
+    // cannot alias it.
+    void Fill(ParticleStorage& particles, size_t begin, size_t count, glm::vec3 origin,
+        SimdLevel simdLevel, WorkerPool* workerPool);
+    // The same for count slots popped from the free list, which must hold at
+    // least that many. Free slots are scattered, so the particles are filled
+    // as contiguous batches and then copied out; the streams are read in the
+    // same order as count single fills would.
+    void FillFreeSlots(ParticleStorage& particles, size_t count, glm::vec3 origin, SimdLevel simdLevel);
+
+private:
+    static const size_t PARALLEL_MIN_PARTICLES = 65536;
+    // Particles per FillFreeSlots() batch: enough to keep the stream fills
+    // vectorized, small enough to stay in L1 with its slot indices.
+    static const size_t FREE_SLOT_BATCH = 512;
+
+    enum Stream {
+        STREAM_VELOCITY_X,
+        STREAM_VELOCITY_Y,
+        STREAM_VELOCITY_Z,
+        STREAM_COLOR,
+        STREAM_SIZE,
+        STREAM_COUNT
+    };
+    RandomStream streams[STREAM_COUNT];
+    // Scratch for FillFreeSlots() batches, sized on first use.
+    ParticleStorage batch;
+};
@@ -0,0 +1,25 @@
+#include "ParticleStateBuffer.h"
+
+ParticleStateBuffer::ParticleStateBuffer() : sequences{ 0, 0, 0 }, stamps{ 0, 0, 0 }, middle(1), writing(0), reading(2), publishes(0) {}
+
+void ParticleStateBuffer::Reserve(size_t capacity) {
+    for (ParticleStorage& state : states)
+        state.Reserve(capacity);
+}
+
+// The exchange releases the copy to the reader and acquires the slot the
+// reader gave back, so the next copy cannot overlap its reads.
+void ParticleStateBuffer::Publish(const ParticleStorage& particles, uint64_t stamp) {
+    states[writing] = particles;
+    stamps[writing] = stamp;
+    uint64_t sequence = publishes.load(std::memory_order_relaxed) + 1;
+    sequences[writing] = sequence;
+    writing = middle.exchange(writing | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    publishes.store(sequence, std::memory_order_release);
+}
+
+const ParticleStorage& ParticleStateBuffer::Acquire() {
+    if ((middle.load(std::memory_order_relaxed) & FRESH) != 0)
+        reading = middle.exchange(reading, std::memory_order_acq_rel) & INDEX_MASK;
+    return states[reading];
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "ParticleStorage.h"
+
+// Hands particle state from the thread that simulates to the thread that
+// renders without locks. Three copies rotate between the writer, the reader
+// and a middle slot: Publish() copies the simulated storage into the
+// writer's copy and exchanges it with the middle one, and Acquire()
+// exchanges the reader's copy with the middle one when something newer was
+// published. Each side is one atomic exchange, so neither ever waits for the
+// other, and the reader sees the newest state, never one being written.
+//
+// Triple rather than double buffered: with two copies the writer would have
+// to wait whenever the reader still held the other one.
+class ParticleStateBuffer {
+public:
+    ParticleStateBuffer();
+
+    ParticleStateBuffer(const ParticleStateBuffer&) = delete;
+    ParticleStateBuffer& operator=(const ParticleStateBuffer&) = delete;
+
+    // Gives every copy room for capacity particles, so publishing never
+    // allocates while the storage stays within that.
+    void Reserve(size_t capacity);
+
+    // Writer side. The copy reuses the columns of a state two publishes old.
+    // stamp travels with the state, for the reader to tell which moment of
+    // the simulation it shows, such as the steps taken up to it.
+    void Publish(const ParticleStorage& particles, uint64_t stamp = 0);
+    // Reader side. The newest published state; it does not change until the
+    // next Acquire(). Empty before the first Publish().
+    const ParticleStorage& Acquire();
+
+    // Publishes so far; may be read from either side.
+    uint64_t Publishes() const { return publishes.load(std::memory_order_acquire); }
+    // Which publish the last Acquire() returned, counting from 1; 0 for none.
+    uint64_t AcquiredSequence() const { return sequences[reading]; }
+    // The stamp published with the state the last Acquire() returned.
+    uint64_t AcquiredStamp() const { return stamps[reading]; }
+
+private:
+    // Set in middle when the copy there has not been acquired yet.
+    static const uint32_t FRESH = 4;
+    static const uint32_t INDEX_MASK = 3;
+
+    ParticleStorage states[3];
+    uint64_t sequences[3];
+    uint64_t stamps[3];
+    // Index of the middle copy, with FRESH.
+    std::atomic<uint32_t> middle;
+    // Owned by the writer and the reader.
+    uint32_t writing;
+    uint32_t reading;
+    std::atomic<uint64_t> publishes;
+};
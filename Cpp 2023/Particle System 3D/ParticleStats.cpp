@@ -0,0 +1,128 @@
+#include "ParticleStats.h"
+
+ParticleStats::ParticleStats()
+    : emits(0), deaths(0), liveParticles(0), updateNanoseconds(0), updateCount(0),
+      renderNanoseconds(0), renderCount(0), uploadBytes(0), cullTested(0), cullVisible(0), sortNanoseconds(0),
+      sortCount(0), reusedSortCount(0), incrementalSortCount(0), frameNanoseconds(0),
+      frameCount(0), maxFrameNanoseconds(0), startTime(Clock::now()), lastSampleTime(startTime),
+      history(), sampleCount(0), dumpedCount(0) {}
+
+void ParticleStats::AddUpdateTime(uint64_t nanoseconds) {
+    updateNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    updateCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ParticleStats::AddCulling(uint64_t tested, uint64_t visible) {
+    cullTested.fetch_add(tested, std::memory_order_relaxed);
+    cullVisible.fetch_add(visible, std::memory_order_relaxed);
+}
+
+void ParticleStats::AddSortTime(uint64_t nanoseconds, bool reusedOrder, bool incremental) {
+    sortNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    sortCount.fetch_add(1, std::memory_order_relaxed);
+    if (reusedOrder)
+        reusedSortCount.fetch_add(1, std::memory_order_relaxed);
+    if (incremental)
+        incrementalSortCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ParticleStats::AddFrameTime(uint64_t nanoseconds) {
+    frameNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    frameCount.fetch_add(1, std::memory_order_relaxed);
+    uint64_t longest = maxFrameNanoseconds.load(std::memory_order_relaxed);
+    while (nanoseconds > longest
+        && !maxFrameNanoseconds.compare_exchange_weak(longest, nanoseconds, std::memory_order_relaxed)) {
+    }
+}
+
+void ParticleStats::AddRenderTime(uint64_t nanoseconds) {
+    renderNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    renderCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+const StatsSample& ParticleStats::Sample() {
+    Clock::time_point now = Clock::now();
+    double window = std::chrono::duration<double>(now - lastSampleTime).count();
+    lastSampleTime = now;
+    if (window <= 0.0)
+        window = 1.0e-9;
+
+    uint64_t updates = updateCount.exchange(0, std::memory_order_relaxed);
+    uint64_t renders = renderCount.exchange(0, std::memory_order_relaxed);
+    uint64_t updateTime = updateNanoseconds.exchange(0, std::memory_order_relaxed);
+    uint64_t renderTime = renderNanoseconds.exchange(0, std::memory_order_relaxed);
+    uint64_t uploaded = uploadBytes.exchange(0, std::memory_order_relaxed);
+    uint64_t tested = cullTested.exchange(0, std::memory_order_relaxed);
+    uint64_t visible = cullVisible.exchange(0, std::memory_order_relaxed);
+    uint64_t sorts = sortCount.exchange(0, std::memory_order_relaxed);
+    uint64_t sortTime = sortNanoseconds.exchange(0, std::memory_order_relaxed);
+    uint64_t reusedSorts = reusedSortCount.exchange(0, std::memory_order_relaxed);
+    uint64_t incrementalSorts = incrementalSortCount.exchange(0, std::memory_order_relaxed);
+    uint64_t frames = frameCount.exchange(0, std::memory_order_relaxed);
+    uint64_t frameTime = frameNanoseconds.exchange(0, std::memory_order_relaxed);
+    uint64_t longestFrame = maxFrameNanoseconds.exchange(0, std::memory_order_relaxed);
+
+    StatsSample& sample = history[sampleCount % HISTORY_SIZE];
+    sample.time = std::chrono::duration<double>(now - startTime).count();
+    sample.liveParticles = liveParticles.load(std::memory_order_relaxed);
+    sample.emitsPerSecond = emits.exchange(0, std::memory_order_relaxed) / window;
+    sample.deathsPerSecond = deaths.exchange(0, std::memory_order_relaxed) / window;
+    sample.updateMilliseconds = updates != 0 ? updateTime / 1.0e6 / updates : 0.0;
+    sample.renderMilliseconds = renders != 0 ? renderTime / 1.0e6 / renders : 0.0;
+    sample.uploadBytesPerFrame = renders != 0 ? static_cast<double>(uploaded) / renders : 0.0;
+    sample.culledFraction = tested != 0 ? static_cast<double>(tested - visible) / tested : 0.0;
+    sample.sortMilliseconds = sorts != 0 ? sortTime / 1.0e6 / sorts : 0.0;
+    sample.incrementalSortFraction = sorts != 0 ? static_cast<double>(incrementalSorts) / sorts : 0.0;
+    sample.incrementalMissFraction = sorts != 0 ? static_cast<double>(reusedSorts - incrementalSorts) / sorts : 0.0;
+    sample.frameMilliseconds = frames != 0 ? frameTime / 1.0e6 / frames : 0.0;
+    sample.maxFrameMilliseconds = longestFrame / 1.0e6;
+    sample.framesPerSecond = frames / window;
+    ++sampleCount;
+    return sample;
+}
+
+void ParticleStats::Dump(std::ostream& out, StatsFormat format) {
+    size_t first = dumpedCount;
+    if (sampleCount - first > HISTORY_SIZE)
+        first = sampleCount - HISTORY_SIZE;
+
+    for (size_t i = first; i < sampleCount; ++i) {
+        const StatsSample& sample = history[i % HISTORY_SIZE];
+        switch (format) {
+        case StatsFormat::Text:
+            out << "[" << sample.time << " s] " << sample.liveParticles << " particles, "
+                << sample.emitsPerSecond << " emits/s, " << sample.deathsPerSecond << " deaths/s, update "
+                << sample.updateMilliseconds << " ms, render " << sample.renderMilliseconds << " ms, "
+                << sample.uploadBytesPerFrame << " upload bytes/frame, " << sample.culledFraction * 100.0
+                << "% culled, sort " << sample.sortMilliseconds << " ms ("
+                << sample.incrementalSortFraction * 100.0 << "% incremental, " << sample.incrementalMissFraction * 100.0
+                << "% missed), frame " << sample.frameMilliseconds << " ms (max " << sample.maxFrameMilliseconds
+                << " ms, " << sample.framesPerSecond << " fps)\n";
+            break;
+        case StatsFormat::Csv:
+            out << sample.time << ',' << sample.liveParticles << ',' << sample.emitsPerSecond << ','
+                << sample.deathsPerSecond << ',' << sample.updateMilliseconds << ','
+                << sample.renderMilliseconds << ',' << sample.uploadBytesPerFrame << ',' << sample.culledFraction
+                << ',' << sample.sortMilliseconds << ',' << sample.incrementalSortFraction << ','
+                << sample.incrementalMissFraction << ',' << sample.frameMilliseconds << ','
+                << sample.maxFrameMilliseconds << ',' << sample.framesPerSecond << '\n';
+            break;
+        case StatsFormat::Binary:
+            out.write(reinterpret_cast<const char*>(&sample), sizeof(sample));
+            break;
+        }
+    }
+    out.flush();
+    dumpedCount = sampleCount;
+}
+
+void ParticleStats::WriteHeader(std::ostream& out, StatsFormat format) {
+    if (format == StatsFormat::Csv) {
+        out << "time,live_particles,emits_per_second,deaths_per_second,update_ms,render_ms,upload_bytes_per_frame,culled_fraction,sort_ms,incremental_sort_fraction,incremental_miss_fraction,frame_ms,max_frame_ms,fps\n";
+    }
+    else if (format == StatsFormat::Binary) {
+        uint32_t version = BINARY_VERSION;
+        out.write("PSTS", 4);
+        out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    }
+}
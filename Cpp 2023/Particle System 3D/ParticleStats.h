@@ -0,0 +1,104 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// One point of the stats history. Rates and times cover the window since
+// the previous sample.
+struct StatsSample {
+    double time;
+    uint64_t liveParticles;
+    double emitsPerSecond;
+    double deathsPerSecond;
+    double updateMilliseconds;
+    double renderMilliseconds;
+    double uploadBytesPerFrame;
+    // Share of the live particles the renderer culled before upload.
+    double culledFraction;
+    // Time spent putting blended particles in draw order, per sorted frame.
+    double sortMilliseconds;
+    // Share of the sorted frames that reused the previous order and fixed
+    // it up by insertion alone: incremental hits.
+    double incrementalSortFraction;
+    // Share that reused the previous order but had moved too far for
+    // insertion and radix sorted some of it: incremental misses.
+    double incrementalMissFraction;
+    // Time between frames: the average, the longest, and frames per second
+    // over the window.
+    double frameMilliseconds;
+    double maxFrameMilliseconds;
+    double framesPerSecond;
+};
+
+enum class StatsFormat {
+    Text,
+    Csv,
+    // "PSTS", a uint32 version, then raw StatsSample records.
+    Binary
+};
+
+// Counters for the particle system. The Add/Set calls are lock-free and may
+// come from any thread; Sample() and Dump() belong to a single thread.
+class ParticleStats {
+public:
+    static const size_t HISTORY_SIZE = 256;
+    static const uint32_t BINARY_VERSION = 6;
+
+    ParticleStats();
+
+    void AddEmits(uint64_t count) { emits.fetch_add(count, std::memory_order_relaxed); }
+    void AddDeaths(uint64_t count) { deaths.fetch_add(count, std::memory_order_relaxed); }
+    void SetLiveParticles(uint64_t count) { liveParticles.store(count, std::memory_order_relaxed); }
+    void AddUpdateTime(uint64_t nanoseconds);
+    void AddRenderTime(uint64_t nanoseconds);
+    void AddUploadBytes(uint64_t bytes) { uploadBytes.fetch_add(bytes, std::memory_order_relaxed); }
+    // Of tested live particles, visible ones passed culling.
+    void AddCulling(uint64_t tested, uint64_t visible);
+    // One frame's depth sort, whether it reused the previous order, and
+    // whether insertion alone then finished it.
+    void AddSortTime(uint64_t nanoseconds, bool reusedOrder, bool incremental);
+    // Time since the previous frame started.
+    void AddFrameTime(uint64_t nanoseconds);
+
+    // Drains the counters into a new sample at the end of the history ring.
+    const StatsSample& Sample();
+
+    // Writes the samples taken since the last dump, oldest first. Samples
+    // that fell out of the ring in the meantime are lost.
+    void Dump(std::ostream& out, StatsFormat format);
+
+    // CSV column names or the binary magic; call once per output stream.
+    static void WriteHeader(std::ostream& out, StatsFormat format);
+
+    size_t SampleCount() const { return sampleCount; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::atomic<uint64_t> emits;
+    std::atomic<uint64_t> deaths;
+    std::atomic<uint64_t> liveParticles;
+    std::atomic<uint64_t> updateNanoseconds;
+    std::atomic<uint64_t> updateCount;
+    std::atomic<uint64_t> renderNanoseconds;
+    std::atomic<uint64_t> renderCount;
+    std::atomic<uint64_t> uploadBytes;
+    std::atomic<uint64_t> cullTested;
+    std::atomic<uint64_t> cullVisible;
+    std::atomic<uint64_t> sortNanoseconds;
+    std::atomic<uint64_t> sortCount;
+    std::atomic<uint64_t> reusedSortCount;
+    std::atomic<uint64_t> incrementalSortCount;
+    std::atomic<uint64_t> frameNanoseconds;
+    std::atomic<uint64_t> frameCount;
+    std::atomic<uint64_t> maxFrameNanoseconds;
+
+    Clock::time_point startTime;
+    Clock::time_point lastSampleTime;
+    std::array<StatsSample, HISTORY_SIZE> history;
+    size_t sampleCount;
+    size_t dumpedCount;
+};
@@ -0,0 +1,313 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <glm/glm.hpp>
+#include "ParticlePool.h"
+#include "ParticleKernels.h"
+
+class Particle {
+public:
+    glm::vec3 position;
+    glm::vec3 velocity;
+    glm::vec4 color;
+    // World-space diameter of the billboard drawn for the particle.
+    float size;
+    float life;
+
+    Particle() : size(0.02f), life(3.5f) {}
+};
+
+// How RemoveDead() gets rid of particles whose life ran out.
+enum class DeathPolicy {
+    // Shifts the survivors down, keeping them in emission order.
+    Compact,
+    // Moves the last particle into the dead slot and shrinks by one.
+    SwapAndPop,
+    // Leaves the slot in place and records it for the next Insert().
+    FreeList
+};
+
+// Colors are stored as RGBA8, red in the lowest byte, which is also the byte
+// order the renderer uploads.
+inline uint32_t PackColor(const glm::vec4& color) {
+    glm::vec4 clamped = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+    return static_cast<uint32_t>(clamped.r) | static_cast<uint32_t>(clamped.g) << 8
+        | static_cast<uint32_t>(clamped.b) << 16 | static_cast<uint32_t>(clamped.a) << 24;
+}
+
+inline glm::vec4 UnpackColor(uint32_t color) {
+    return glm::vec4(color & 0xff, (color >> 8) & 0xff, (color >> 16) & 0xff, color >> 24) / 255.0f;
+}
+
+using FloatColumn = std::vector<float, ColumnAllocator<float>>;
+using ColorColumn = std::vector<uint32_t, ColumnAllocator<uint32_t>>;
+
+// Structure-of-arrays particle storage. Every attribute lives in its own
+// contiguous, cache-line aligned column, so the update loop only streams
+// the data it touches.
+class ParticleStorage {
+public:
+    FloatColumn positionX, positionY, positionZ;
+    FloatColumn velocityX, velocityY, velocityZ;
+    ColorColumn color;
+    FloatColumn size;
+    FloatColumn life;
+    DeathPolicy deathPolicy;
+
+    ParticleStorage() : deathPolicy(DeathPolicy::SwapAndPop) {}
+
+    // Number of slots, including free ones under DeathPolicy::FreeList.
+    size_t Size() const { return life.size(); }
+    size_t LiveCount() const { return life.size() - freeSlots.size(); }
+    bool Empty() const { return LiveCount() == 0; }
+
+    // Free slots are never alive, so this also skips them.
+    bool IsAlive(size_t index) const { return life[index] > 0.0f; }
+
+    void Reserve(size_t count) {
+        positionX.reserve(count); positionY.reserve(count); positionZ.reserve(count);
+        velocityX.reserve(count); velocityY.reserve(count); velocityZ.reserve(count);
+        color.reserve(count);
+        size.reserve(count);
+        life.reserve(count);
+    }
+
+    // Empties the storage and moves every column into pool, with room for
+    // capacity particles, so it never allocates again while it stays within
+    // that. The free list is reserved as well, on the heap. A null pool
+    // moves the columns back to the heap.
+    void UsePool(ParticlePool* pool, size_t capacity) {
+        freeSlots.clear();
+        positionX = FloatColumn(ColumnAllocator<float>(pool));
+        positionY = FloatColumn(ColumnAllocator<float>(pool));
+        positionZ = FloatColumn(ColumnAllocator<float>(pool));
+        velocityX = FloatColumn(ColumnAllocator<float>(pool));
+        velocityY = FloatColumn(ColumnAllocator<float>(pool));
+        velocityZ = FloatColumn(ColumnAllocator<float>(pool));
+        color = ColorColumn(ColumnAllocator<uint32_t>(pool));
+        size = FloatColumn(ColumnAllocator<float>(pool));
+        life = FloatColumn(ColumnAllocator<float>(pool));
+        Reserve(capacity);
+        freeSlots.reserve(capacity);
+    }
+
+    void Clear() {
+        positionX.clear(); positionY.clear(); positionZ.clear();
+        velocityX.clear(); velocityY.clear(); velocityZ.clear();
+        color.clear();
+        size.clear();
+        life.clear();
+        freeSlots.clear();
+    }
+
+    // Stores the particle in a free slot if there is one, otherwise appends it.
+    void Insert(const Particle& particle) {
+        if (freeSlots.empty()) {
+            PushBack(particle);
+            return;
+        }
+        Set(PopFreeSlot(), particle);
+    }
+
+    size_t FreeSlotCount() const { return freeSlots.size(); }
+    // In the order they were freed; PopFreeSlot() takes from the back.
+    const std::vector<size_t>& FreeSlots() const { return freeSlots; }
+
+    // Replaces the free list, for storage whose columns were copied in whole.
+    // Every listed slot must already hold a free slot's life.
+    void AssignFreeSlots(const uint64_t* slots, size_t count) {
+        freeSlots.assign(slots, slots + count);
+    }
+
+    // Hands out a free slot; the caller must fill every column at that index.
+    size_t PopFreeSlot() {
+        size_t index = freeSlots.back();
+        freeSlots.pop_back();
+        return index;
+    }
+
+    // Adds count slots at the end and returns the index of the first. The
+    // caller must fill every column of the new range.
+    size_t Append(size_t count) {
+        size_t first = Size();
+        Resize(first + count);
+        return first;
+    }
+
+    // Adds count slots at the end that are neither alive nor on the free
+    // list, for storage carved into fixed segments that track their own
+    // live ranges. LiveCount() counts them, so such storage keeps its own
+    // counts. Returns the index of the first.
+    size_t AppendReserved(size_t count) {
+        size_t first = Append(count);
+        std::fill(life.begin() + first, life.end(), FREE_SLOT_LIFE);
+        return first;
+    }
+
+    // Swap-and-pop over the particles [begin, end) alone, for a segment of
+    // reserved slots whose live particles are packed at its front. Returns
+    // the new end; the slots behind it are reserved again.
+    size_t RemoveDeadInRange(size_t begin, size_t end) {
+        size_t i = begin;
+        while (i < end) {
+            if (life[i] > 0.0f) {
+                ++i;
+                continue;
+            }
+            --end;
+            if (i != end)
+                Move(end, i);
+            life[end] = FREE_SLOT_LIFE;
+        }
+        return end;
+    }
+
+    void PushBack(const Particle& particle) {
+        positionX.push_back(particle.position.x);
+        positionY.push_back(particle.position.y);
+        positionZ.push_back(particle.position.z);
+        velocityX.push_back(particle.velocity.x);
+        velocityY.push_back(particle.velocity.y);
+        velocityZ.push_back(particle.velocity.z);
+        color.push_back(PackColor(particle.color));
+        size.push_back(particle.size);
+        life.push_back(particle.life);
+    }
+
+    void Set(size_t index, const Particle& particle) {
+        positionX[index] = particle.position.x;
+        positionY[index] = particle.position.y;
+        positionZ[index] = particle.position.z;
+        velocityX[index] = particle.velocity.x;
+        velocityY[index] = particle.velocity.y;
+        velocityZ[index] = particle.velocity.z;
+        color[index] = PackColor(particle.color);
+        size[index] = particle.size;
+        life[index] = particle.life;
+    }
+
+    Particle Get(size_t index) const {
+        Particle particle;
+        particle.position = Position(index);
+        particle.velocity = Velocity(index);
+        particle.color = UnpackColor(color[index]);
+        particle.size = size[index];
+        particle.life = life[index];
+        return particle;
+    }
+
+    glm::vec3 Position(size_t index) const {
+        return glm::vec3(positionX[index], positionY[index], positionZ[index]);
+    }
+
+    glm::vec3 Velocity(size_t index) const {
+        return glm::vec3(velocityX[index], velocityY[index], velocityZ[index]);
+    }
+
+    ParticleSpan Span() {
+        ParticleSpan span;
+        span.positionX = positionX.data();
+        span.positionY = positionY.data();
+        span.positionZ = positionZ.data();
+        span.velocityX = velocityX.data();
+        span.velocityY = velocityY.data();
+        span.velocityZ = velocityZ.data();
+        span.life = life.data();
+        span.count = Size();
+        return span;
+    }
+
+    ConstParticleSpan Span() const {
+        ConstParticleSpan span;
+        span.positionX = positionX.data();
+        span.positionY = positionY.data();
+        span.positionZ = positionZ.data();
+        span.velocityX = velocityX.data();
+        span.velocityY = velocityY.data();
+        span.velocityZ = velocityZ.data();
+        span.life = life.data();
+        span.count = Size();
+        return span;
+    }
+
+    // Gets rid of every particle whose life ran out, as deathPolicy says.
+    void RemoveDead() {
+        switch (deathPolicy) {
+        case DeathPolicy::Compact:
+            RemoveDeadCompact();
+            break;
+        case DeathPolicy::SwapAndPop:
+            RemoveDeadSwapAndPop();
+            break;
+        case DeathPolicy::FreeList:
+            RemoveDeadFreeList();
+            break;
+        }
+    }
+
+private:
+    // Life of a slot already on the free list. It stays -infinity however
+    // much the update kernel ages it, so RemoveDead() never records it twice.
+    static constexpr float FREE_SLOT_LIFE = -std::numeric_limits<float>::infinity();
+
+    std::vector<size_t> freeSlots;
+
+    void RemoveDeadCompact() {
+        size_t count = Size();
+        size_t alive = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (life[i] <= 0.0f)
+                continue;
+            if (alive != i)
+                Move(i, alive);
+            ++alive;
+        }
+        Resize(alive);
+    }
+
+    void RemoveDeadSwapAndPop() {
+        size_t count = Size();
+        size_t i = 0;
+        while (i < count) {
+            if (life[i] > 0.0f) {
+                ++i;
+                continue;
+            }
+            // The moved-in particle may be dead too, so index i is checked again.
+            --count;
+            if (i != count)
+                Move(count, i);
+        }
+        Resize(count);
+    }
+
+    void RemoveDeadFreeList() {
+        size_t count = Size();
+        for (size_t i = 0; i < count; ++i) {
+            if (life[i] > 0.0f || life[i] == FREE_SLOT_LIFE)
+                continue;
+            life[i] = FREE_SLOT_LIFE;
+            velocityX[i] = 0.0f; velocityY[i] = 0.0f; velocityZ[i] = 0.0f;
+            freeSlots.push_back(i);
+        }
+    }
+
+    void Move(size_t from, size_t to) {
+        positionX[to] = positionX[from]; positionY[to] = positionY[from]; positionZ[to] = positionZ[from];
+        velocityX[to] = velocityX[from]; velocityY[to] = velocityY[from]; velocityZ[to] = velocityZ[from];
+        color[to] = color[from];
+        size[to] = size[from];
+        life[to] = life[from];
+    }
+
+    void Resize(size_t count) {
+        positionX.resize(count); positionY.resize(count); positionZ.resize(count);
+        velocityX.resize(count); velocityY.resize(count); velocityZ.resize(count);
+        color.resize(count);
+        size.resize(count);
+        life.resize(count);
+    }
+};
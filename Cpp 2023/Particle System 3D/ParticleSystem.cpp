@@ -0,0 +1,136 @@
+#include "ParticleSystem.h"
+#include <atomic>
+#include <chrono>
+
+namespace {
+    // Segments start on a cache line, so emitters updated on different
+    // threads never write to the same line of a float column.
+    const size_t SEGMENT_ALIGNMENT = CACHE_LINE_SIZE / sizeof(float);
+
+    // Per-emitter seeds run through the SplitMix64 finalizer, since seeds one
+    // SplitMix increment apart would give overlapping xoshiro states.
+    uint64_t MixIndex(uint64_t index) {
+        uint64_t z = index * 0x9e3779b97f4a7c15ull + 0x632be59bd9b4e019ull;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+}
+
+ParticleSystem::ParticleSystem()
+    : simdLevel(DetectSimdLevel()), workerPool(nullptr), stats(nullptr), integrator(Integrator::Euler), liveCount(0), lastCollisions(0),
+      emitSeed(1), emitEngine(RandomEngine::Xoshiro256), pendingEmits(0) {
+    SphereCollider sphere;
+    sphere.center = glm::vec3(0.0f, -1.0f, 0.0f);
+    sphere.radius = 0.5f;
+    colliders.push_back(sphere);
+}
+
+void ParticleSystem::Seed(uint64_t seed, RandomEngine engine) {
+    emitSeed = seed;
+    emitEngine = engine;
+    for (size_t i = 0; i < emitters.size(); ++i)
+        emitters[i].spawner.Seed(EmitterSeed(i), engine);
+}
+
+uint64_t ParticleSystem::EmitterSeed(size_t index) const {
+    return emitSeed ^ MixIndex(index);
+}
+
+size_t ParticleSystem::AddEmitter(const glm::vec3& position, float emitInterval, size_t maxParticles) {
+    size_t capacity = (maxParticles + SEGMENT_ALIGNMENT - 1) / SEGMENT_ALIGNMENT * SEGMENT_ALIGNMENT;
+
+    PooledEmitter emitter;
+    emitter.position = position;
+    emitter.emitInterval = emitInterval;
+    emitter.currentTime = 0.0f;
+    emitter.begin = particles.AppendReserved(capacity);
+    // Only the requested room is used; the rest pads to the next cache line.
+    emitter.capacity = maxParticles;
+    emitter.count = 0;
+    emitter.spawner.Seed(EmitterSeed(emitters.size()), emitEngine);
+    emitters.push_back(emitter);
+    return emitters.size() - 1;
+}
+
+size_t ParticleSystem::EmitParticles(size_t index, size_t count) {
+    PooledEmitter& emitter = emitters[index];
+    size_t room = emitter.capacity - emitter.count;
+    size_t emitted = count < room ? count : room;
+    emitter.spawner.Fill(particles, emitter.begin + emitter.count, emitted, emitter.position, simdLevel, workerPool);
+    emitter.count += emitted;
+    liveCount += emitted;
+    pendingEmits += emitted;
+    return emitted;
+}
+
+// Each job owns whole emitters, and an emitter touches nothing outside its
+// segment and spawner, so the jobs share no writes until their totals are
+// added up.
+void ParticleSystem::Update(float deltaTime) {
+    std::chrono::steady_clock::time_point start;
+    if (stats != nullptr)
+        start = std::chrono::steady_clock::now();
+
+    const SphereCollider* fused = colliders.empty() ? nullptr : &colliders[0];
+    ParticleSpan span = particles.Span();
+    std::atomic<size_t> emits(0);
+    std::atomic<size_t> deaths(0);
+    std::atomic<size_t> collisions(0);
+
+    auto updateEmitters = [&](size_t first, size_t last) {
+        size_t jobEmits = 0;
+        size_t jobDeaths = 0;
+        size_t jobCollisions = 0;
+        for (size_t e = first; e < last; ++e) {
+            PooledEmitter& emitter = emitters[e];
+
+            emitter.currentTime += deltaTime;
+            if (emitter.currentTime >= emitter.emitInterval) {
+                size_t due = static_cast<size_t>(emitter.currentTime / emitter.emitInterval);
+                size_t room = emitter.capacity - emitter.count;
+                size_t emitted = due < room ? due : room;
+                emitter.spawner.Fill(particles, emitter.begin + emitter.count, emitted, emitter.position,
+                    simdLevel, nullptr);
+                emitter.count += emitted;
+                emitter.currentTime -= static_cast<float>(emitted) * emitter.emitInterval;
+                jobEmits += emitted;
+            }
+
+            size_t end = emitter.begin + emitter.count;
+            ParticleSpan range = SliceSpan(span, emitter.begin, end);
+            jobCollisions += IntegrateParticles(simdLevel, range, deltaTime, forces, integrator, fused);
+            for (size_t c = 1; c < colliders.size(); ++c)
+                jobCollisions += CollideSphere(simdLevel, range, colliders[c]);
+
+            size_t liveEnd = particles.RemoveDeadInRange(emitter.begin, end);
+            jobDeaths += end - liveEnd;
+            emitter.count = liveEnd - emitter.begin;
+        }
+        emits.fetch_add(jobEmits, std::memory_order_relaxed);
+        deaths.fetch_add(jobDeaths, std::memory_order_relaxed);
+        collisions.fetch_add(jobCollisions, std::memory_order_relaxed);
+    };
+
+    if (workerPool != nullptr && emitters.size() > 1) {
+        size_t jobs = workerPool->ThreadCount() * JOBS_PER_THREAD;
+        size_t chunkSize = (emitters.size() + jobs - 1) / jobs;
+        workerPool->ParallelFor(emitters.size(), chunkSize, updateEmitters);
+    }
+    else {
+        updateEmitters(0, emitters.size());
+    }
+
+    pendingEmits += emits.load(std::memory_order_relaxed);
+    liveCount = liveCount + emits.load(std::memory_order_relaxed) - deaths.load(std::memory_order_relaxed);
+    lastCollisions = collisions.load(std::memory_order_relaxed);
+
+    if (stats != nullptr) {
+        stats->AddEmits(pendingEmits);
+        stats->AddDeaths(deaths.load(std::memory_order_relaxed));
+        stats->SetLiveParticles(liveCount);
+        stats->AddUpdateTime(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count()));
+    }
+    pendingEmits = 0;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "ParticleStorage.h"
+#include "ParticleKernels.h"
+#include "ParticleSpawner.h"
+#include "ParticleStats.h"
+#include "Random.h"
+#include "WorkerPool.h"
+
+// One emitter of a ParticleSystem. It emits one particle every emitInterval
+// seconds, like ParticleGenerator, into its own segment of the shared
+// storage: capacity slots from begin, of which the first count are live.
+struct PooledEmitter {
+    glm::vec3 position;
+    float emitInterval;
+    // Time owed to emission, as in ParticleGenerator.
+    float currentTime;
+    size_t begin;
+    size_t capacity;
+    size_t count;
+    ParticleSpawner spawner;
+};
+
+// Owns many emitters whose particles share one ParticleStorage, carved into
+// a fixed segment per emitter. Update() emits, integrates, collides and
+// compacts every emitter in one parallel pass, and the renderer draws the
+// whole storage with one buffer and one draw call. Colliders are shared by
+// all emitters and always tested brute force.
+class ParticleSystem {
+public:
+    // Every segment, including its reserved slots. Only slots that are alive
+    // hold particles, so use ParticleCount() rather than LiveCount().
+    ParticleStorage particles;
+    SimdLevel simdLevel;
+    // When set, Update() splits the emitters across the pool's threads.
+    WorkerPool* workerPool;
+    // When set, Update() reports emits, deaths, live count and its own time.
+    ParticleStats* stats;
+    // Applied by Update() in the same pass that moves the particles.
+    ForceField forces;
+    // Euler by default; see Integrator for the cost and accuracy of each.
+    Integrator integrator;
+    std::vector<SphereCollider> colliders;
+
+    ParticleSystem();
+
+    // Reseeds every emitter. Emitter i draws from EmitterSeed(i), so it emits
+    // what a ParticleEmitter seeded with that value would.
+    void Seed(uint64_t seed, RandomEngine engine = RandomEngine::Xoshiro256);
+    uint64_t EmitterSeed(size_t index) const;
+
+    // Adds an emitter with room for maxParticles and returns its index. The
+    // storage grows, so add emitters before handing out spans or pointers.
+    size_t AddEmitter(const glm::vec3& position, float emitInterval, size_t maxParticles);
+    size_t EmitterCount() const { return emitters.size(); }
+    // Position and interval may be changed; the segment belongs to the system.
+    PooledEmitter& Emitter(size_t index) { return emitters[index]; }
+    const PooledEmitter& Emitter(size_t index) const { return emitters[index]; }
+
+    // Emits up to count particles from one emitter, as many as its segment
+    // has room for, and returns how many it emitted.
+    size_t EmitParticles(size_t index, size_t count);
+    void Update(float deltaTime);
+
+    size_t ParticleCount() const { return liveCount; }
+    size_t LastCollisions() const { return lastCollisions; }
+
+private:
+    // Jobs per pool thread, so uneven emitters still balance out.
+    static const size_t JOBS_PER_THREAD = 4;
+
+    std::vector<PooledEmitter> emitters;
+    size_t liveCount;
+    size_t lastCollisions;
+    uint64_t emitSeed;
+    RandomEngine emitEngine;
+    // Emits since the last Update(), handed to stats in one atomic add.
+    uint64_t pendingEmits;
+};
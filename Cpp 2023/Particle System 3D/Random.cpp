@@ -0,0 +1,275 @@
+#include "Random.h"
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define RANDOM_X86 1
+#include <immintrin.h>
+#endif
+
+// GCC and Clang only emit AVX2 instructions inside functions that opt in;
+// MSVC accepts the intrinsics anywhere.
+#if defined(__GNUC__) || defined(__clang__)
+#define RANDOM_TARGET_SSE2 __attribute__((target("sse2")))
+#define RANDOM_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define RANDOM_TARGET_SSE2
+#define RANDOM_TARGET_AVX2
+#endif
+
+namespace {
+
+const size_t LANES = RandomStream::LANES;
+const size_t BLOCK_VALUES = 2 * LANES;
+
+inline uint64_t Rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+inline uint64_t SplitMix64(uint64_t& x) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+inline uint32_t CounterHash(uint32_t counter, uint32_t key) {
+    uint32_t x = counter * 0x9e3779b9u + key;
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Each lockstep step writes lane l's 64-bit output as values 2l (low half)
+// and 2l + 1 (high half) of the block, which is the little-endian layout the
+// vector paths get for free.
+void StepScalar(uint64_t* lanes, uint32_t* out, size_t blocks) {
+    uint64_t* s0 = lanes;
+    uint64_t* s1 = lanes + LANES;
+    uint64_t* s2 = lanes + 2 * LANES;
+    uint64_t* s3 = lanes + 3 * LANES;
+    for (size_t b = 0; b < blocks; ++b, out += BLOCK_VALUES) {
+        for (size_t l = 0; l < LANES; ++l) {
+            uint64_t result = Rotl(s1[l] * 5, 7) * 9;
+            uint64_t t = s1[l] << 17;
+            s2[l] ^= s0[l];
+            s3[l] ^= s1[l];
+            s1[l] ^= s2[l];
+            s0[l] ^= s3[l];
+            s2[l] ^= t;
+            s3[l] = Rotl(s3[l], 45);
+
+            out[2 * l] = static_cast<uint32_t>(result);
+            out[2 * l + 1] = static_cast<uint32_t>(result >> 32);
+        }
+    }
+}
+
+#if RANDOM_X86
+
+// Multiplies by 5 and 9 are shifts and adds, since there is no 64-bit vector
+// multiply before AVX-512.
+RANDOM_TARGET_SSE2
+inline __m128i RotlSSE2(__m128i x, int k) {
+    return _mm_or_si128(_mm_slli_epi64(x, k), _mm_srli_epi64(x, 64 - k));
+}
+
+RANDOM_TARGET_SSE2
+void StepSSE2(uint64_t* lanes, uint32_t* out, size_t blocks) {
+    const size_t registers = LANES / 2;
+    __m128i s0[registers], s1[registers], s2[registers], s3[registers];
+    for (size_t r = 0; r < registers; ++r) {
+        s0[r] = _mm_load_si128(reinterpret_cast<const __m128i*>(lanes + 2 * r));
+        s1[r] = _mm_load_si128(reinterpret_cast<const __m128i*>(lanes + LANES + 2 * r));
+        s2[r] = _mm_load_si128(reinterpret_cast<const __m128i*>(lanes + 2 * LANES + 2 * r));
+        s3[r] = _mm_load_si128(reinterpret_cast<const __m128i*>(lanes + 3 * LANES + 2 * r));
+    }
+
+    for (size_t b = 0; b < blocks; ++b, out += BLOCK_VALUES) {
+        for (size_t r = 0; r < registers; ++r) {
+            __m128i times5 = _mm_add_epi64(_mm_slli_epi64(s1[r], 2), s1[r]);
+            __m128i rotated = RotlSSE2(times5, 7);
+            __m128i result = _mm_add_epi64(_mm_slli_epi64(rotated, 3), rotated);
+            __m128i t = _mm_slli_epi64(s1[r], 17);
+            s2[r] = _mm_xor_si128(s2[r], s0[r]);
+            s3[r] = _mm_xor_si128(s3[r], s1[r]);
+            s1[r] = _mm_xor_si128(s1[r], s2[r]);
+            s0[r] = _mm_xor_si128(s0[r], s3[r]);
+            s2[r] = _mm_xor_si128(s2[r], t);
+            s3[r] = RotlSSE2(s3[r], 45);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4 * r), result);
+        }
+    }
+
+    for (size_t r = 0; r < registers; ++r) {
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes + 2 * r), s0[r]);
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes + LANES + 2 * r), s1[r]);
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes + 2 * LANES + 2 * r), s2[r]);
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes + 3 * LANES + 2 * r), s3[r]);
+    }
+}
+
+RANDOM_TARGET_AVX2
+inline __m256i RotlAVX2(__m256i x, int k) {
+    return _mm256_or_si256(_mm256_slli_epi64(x, k), _mm256_srli_epi64(x, 64 - k));
+}
+
+RANDOM_TARGET_AVX2
+void StepAVX2(uint64_t* lanes, uint32_t* out, size_t blocks) {
+    const size_t registers = LANES / 4;
+    __m256i s0[registers], s1[registers], s2[registers], s3[registers];
+    for (size_t r = 0; r < registers; ++r) {
+        s0[r] = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes + 4 * r));
+        s1[r] = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes + LANES + 4 * r));
+        s2[r] = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes + 2 * LANES + 4 * r));
+        s3[r] = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes + 3 * LANES + 4 * r));
+    }
+
+    for (size_t b = 0; b < blocks; ++b, out += BLOCK_VALUES) {
+        for (size_t r = 0; r < registers; ++r) {
+            __m256i times5 = _mm256_add_epi64(_mm256_slli_epi64(s1[r], 2), s1[r]);
+            __m256i rotated = RotlAVX2(times5, 7);
+            __m256i result = _mm256_add_epi64(_mm256_slli_epi64(rotated, 3), rotated);
+            __m256i t = _mm256_slli_epi64(s1[r], 17);
+            s2[r] = _mm256_xor_si256(s2[r], s0[r]);
+            s3[r] = _mm256_xor_si256(s3[r], s1[r]);
+            s1[r] = _mm256_xor_si256(s1[r], s2[r]);
+            s0[r] = _mm256_xor_si256(s0[r], s3[r]);
+            s2[r] = _mm256_xor_si256(s2[r], t);
+            s3[r] = RotlAVX2(s3[r], 45);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 8 * r), result);
+        }
+    }
+
+    for (size_t r = 0; r < registers; ++r) {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes + 4 * r), s0[r]);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes + LANES + 4 * r), s1[r]);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes + 2 * LANES + 4 * r), s2[r]);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes + 3 * LANES + 4 * r), s3[r]);
+    }
+}
+
+#endif
+
+}
+
+Xoshiro256::Xoshiro256(uint64_t seed, uint64_t stream) {
+    uint64_t x = seed;
+    for (int i = 0; i < 4; ++i)
+        state[i] = SplitMix64(x);
+    for (uint64_t i = 0; i < stream; ++i)
+        Jump();
+}
+
+uint64_t Xoshiro256::Next() {
+    uint64_t result = Rotl(state[1] * 5, 7) * 9;
+    uint64_t t = state[1] << 17;
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= t;
+    state[3] = Rotl(state[3], 45);
+    return result;
+}
+
+void Xoshiro256::Jump() {
+    static const uint64_t JUMP[] = { 0x180ec6d33cfd0abaull, 0xd5a61266f0c9392cull, 0xa9582618e03fc9aaull, 0x39abdc4529b1661cull };
+
+    uint64_t jumped[4] = { 0, 0, 0, 0 };
+    for (uint64_t word : JUMP) {
+        for (int bit = 0; bit < 64; ++bit) {
+            if (word & (1ull << bit)) {
+                for (int i = 0; i < 4; ++i)
+                    jumped[i] ^= state[i];
+            }
+            Next();
+        }
+    }
+    std::memcpy(state, jumped, sizeof(state));
+}
+
+// The lanes of stream n are streams n * LANES .. n * LANES + LANES - 1 of the
+// seed, reached by jumping one after the other.
+RandomStream::RandomStream(uint64_t seed, uint64_t stream, RandomEngine _engine)
+    : engine(_engine), simdLevel(DetectSimdLevel()), buffered(0) {
+    Xoshiro256 generator(seed, stream * LANES);
+    for (size_t l = 0; l < LANES; ++l) {
+        for (size_t w = 0; w < 4; ++w)
+            lanes[w * LANES + l] = generator.state[w];
+        generator.Jump();
+    }
+
+    counter = 0;
+    key = CounterHash(static_cast<uint32_t>(seed) ^ CounterHash(static_cast<uint32_t>(seed >> 32), 0),
+        static_cast<uint32_t>(stream) + 1);
+}
+
+void RandomStream::FillBits(uint32_t* out, size_t count) {
+    if (engine == RandomEngine::CounterHash) {
+        for (size_t i = 0; i < count; ++i)
+            out[i] = CounterHash(counter + static_cast<uint32_t>(i), key);
+        counter += static_cast<uint32_t>(count);
+        return;
+    }
+
+    // Leftovers of the previous call come first, so splitting a fill never
+    // changes the sequence.
+    while (count > 0 && buffered > 0) {
+        *out++ = buffer[BLOCK_VALUES - buffered];
+        --buffered;
+        --count;
+    }
+
+    size_t blocks = count / BLOCK_VALUES;
+    FillBlocks(out, blocks);
+    out += blocks * BLOCK_VALUES;
+    count -= blocks * BLOCK_VALUES;
+
+    if (count > 0) {
+        FillBlocks(buffer, 1);
+        buffered = BLOCK_VALUES;
+        while (count > 0) {
+            *out++ = buffer[BLOCK_VALUES - buffered];
+            --buffered;
+            --count;
+        }
+    }
+}
+
+void RandomStream::FillUniform(float* out, size_t count, float low, float high) {
+    const size_t CHUNK = 256;
+    uint32_t bits[CHUNK];
+    float scale = (high - low) * (1.0f / 16777216.0f);
+
+    while (count > 0) {
+        size_t n = count < CHUNK ? count : CHUNK;
+        FillBits(bits, n);
+        for (size_t i = 0; i < n; ++i)
+            out[i] = low + static_cast<float>(static_cast<int32_t>(bits[i] >> 8)) * scale;
+        out += n;
+        count -= n;
+    }
+}
+
+void RandomStream::FillBlocks(uint32_t* out, size_t blocks) {
+    if (blocks == 0)
+        return;
+
+    SimdLevel level = simdLevel > DetectSimdLevel() ? DetectSimdLevel() : simdLevel;
+    switch (level) {
+#if RANDOM_X86
+    case SimdLevel::AVX2:
+        StepAVX2(lanes, out, blocks);
+        break;
+    case SimdLevel::SSE2:
+        StepSSE2(lanes, out, blocks);
+        break;
+#endif
+    default:
+        StepScalar(lanes, out, blocks);
+        break;
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "ParticleKernels.h"
+
+// xoshiro256** by Blackman and Vigna: 256 bits of state, period 2^256 - 1,
+// and every output bit passes BigCrush.
+class Xoshiro256 {
+public:
+    uint64_t state[4];
+
+    // The seed is expanded through SplitMix64, so nearby seeds give unrelated
+    // states. Stream n is that state jumped 2^128 steps n times, so streams
+    // never overlap.
+    explicit Xoshiro256(uint64_t seed = 1, uint64_t stream = 0);
+
+    uint64_t Next();
+    // Advances the state by 2^128 steps.
+    void Jump();
+};
+
+enum class RandomEngine {
+    // Eight xoshiro256** generators stepped in lockstep, two 32-bit outputs
+    // each per step.
+    Xoshiro256,
+    // A hash of an output counter and a key: no state between outputs, but
+    // statistically weaker.
+    CounterHash
+};
+
+// One independent sequence of random 32-bit values. The sequence depends only
+// on the seed, stream and engine, never on how the fills are split up or on
+// the SIMD level, so a seeded run is reproducible bit for bit. Streams are
+// not shared between threads: give each thread or each consumer its own
+// stream index.
+class RandomStream {
+public:
+    RandomEngine engine;
+    SimdLevel simdLevel;
+
+    explicit RandomStream(uint64_t seed = 1, uint64_t stream = 0, RandomEngine engine = RandomEngine::Xoshiro256);
+
+    void FillBits(uint32_t* out, size_t count);
+    // Uniform in [low, high), from the top 24 bits of each value.
+    void FillUniform(float* out, size_t count, float low, float high);
+
+    static const size_t LANES = 8;
+
+private:
+    // Xoshiro256 state, lane-interleaved: word w of lane l is at w * LANES + l.
+    alignas(32) uint64_t lanes[4 * LANES];
+    // Outputs of the last lockstep step not handed out yet.
+    uint32_t buffer[2 * LANES];
+    size_t buffered;
+
+    // CounterHash state.
+    uint32_t counter;
+    uint32_t key;
+
+    void FillBlocks(uint32_t* out, size_t blocks);
+};
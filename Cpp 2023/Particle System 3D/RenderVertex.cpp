@@ -0,0 +1,154 @@
+#include "RenderVertex.h"
+#include <cstring>
+#include <limits>
+
+namespace {
+    const uint16_t HALF_ONE = 0x3c00;
+
+    // Float to half with round-to-nearest-even, including NaN, infinity and
+    // subnormals, without the table lookups and branches of
+    // glm::packHalf1x16. Uses a float add to do the rounding of small values.
+    uint16_t FloatToHalf(float value) {
+        const uint32_t floatInfinity = 255u << 23;
+        const uint32_t halfOverflow = (127u + 16u) << 23;
+        const uint32_t signMask = 0x80000000u;
+
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        uint32_t sign = bits & signMask;
+        bits ^= sign;
+
+        uint16_t half;
+        if (bits >= halfOverflow) {
+            // Overflow becomes infinity, NaN stays a quiet NaN.
+            half = bits > floatInfinity ? 0x7e00 : 0x7c00;
+        }
+        else if (bits < (113u << 23)) {
+            // Subnormal half: let the float adder shift and round.
+            const uint32_t denormalMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+            float magic;
+            std::memcpy(&magic, &denormalMagic, sizeof(magic));
+            float shifted;
+            std::memcpy(&shifted, &bits, sizeof(shifted));
+            shifted += magic;
+            uint32_t shiftedBits;
+            std::memcpy(&shiftedBits, &shifted, sizeof(shiftedBits));
+            half = static_cast<uint16_t>(shiftedBits - denormalMagic);
+        }
+        else {
+            uint32_t mantissaOdd = (bits >> 13) & 1u;
+            bits += (static_cast<uint32_t>(15 - 127) << 23) + 0xfffu;
+            bits += mantissaOdd;
+            half = static_cast<uint16_t>(bits >> 13);
+        }
+        return static_cast<uint16_t>(half | (sign >> 16));
+    }
+
+    // Scales the alpha byte of an RGBA8 color by life / fadeTime, capped at 1.
+    uint32_t FadeColor(uint32_t color, float life, float inverseFadeTime) {
+        float fade = life * inverseFadeTime;
+        if (fade >= 1.0f)
+            return color;
+        uint32_t alpha = static_cast<uint32_t>(static_cast<float>(color >> 24) * fade + 0.5f);
+        return (color & 0x00ffffffu) | alpha << 24;
+    }
+
+    // Every live slot in [begin, end), in order.
+    struct LiveSlots {
+        const ParticleStorage& particles;
+        size_t begin;
+        size_t end;
+
+        template <typename Pack>
+        void ForEach(Pack pack) const {
+            for (size_t i = begin; i < end; ++i) {
+                if (particles.IsAlive(i))
+                    pack(i);
+            }
+        }
+    };
+
+    // The slots of an index list, such as the one CullParticles() writes.
+    struct ListedSlots {
+        const uint32_t* indices;
+        size_t count;
+
+        template <typename Pack>
+        void ForEach(Pack pack) const {
+            for (size_t k = 0; k < count; ++k)
+                pack(indices[k]);
+        }
+    };
+
+    template <typename Slots>
+    size_t PackSlots(const ParticleStorage& particles, const Slots& slots, float lookahead, float fadeTime,
+        RenderVertexFormat format, void* out) {
+        size_t written = 0;
+        // Live particles have life > 0, so an infinite inverse never fades them.
+        float inverseFadeTime = fadeTime > 0.0f ? 1.0f / fadeTime : std::numeric_limits<float>::infinity();
+
+        if (format == RenderVertexFormat::Half3) {
+            RenderVertexHalf3* vertices = static_cast<RenderVertexHalf3*>(out);
+            slots.ForEach([&](size_t i) {
+                RenderVertexHalf3& vertex = vertices[written++];
+                vertex.x = FloatToHalf(particles.positionX[i] + particles.velocityX[i] * lookahead);
+                vertex.y = FloatToHalf(particles.positionY[i] + particles.velocityY[i] * lookahead);
+                vertex.z = FloatToHalf(particles.positionZ[i] + particles.velocityZ[i] * lookahead);
+                vertex.w = HALF_ONE;
+                vertex.color = FadeColor(particles.color[i], particles.life[i], inverseFadeTime);
+            });
+            return written;
+        }
+
+        if (format == RenderVertexFormat::Billboard) {
+            RenderVertexBillboard* vertices = static_cast<RenderVertexBillboard*>(out);
+            slots.ForEach([&](size_t i) {
+                RenderVertexBillboard& vertex = vertices[written++];
+                vertex.x = particles.positionX[i] + particles.velocityX[i] * lookahead;
+                vertex.y = particles.positionY[i] + particles.velocityY[i] * lookahead;
+                vertex.z = particles.positionZ[i] + particles.velocityZ[i] * lookahead;
+                vertex.size = particles.size[i];
+                vertex.color = FadeColor(particles.color[i], particles.life[i], inverseFadeTime);
+            });
+            return written;
+        }
+
+        if (format == RenderVertexFormat::BillboardHalf) {
+            RenderVertexBillboardHalf* vertices = static_cast<RenderVertexBillboardHalf*>(out);
+            slots.ForEach([&](size_t i) {
+                RenderVertexBillboardHalf& vertex = vertices[written++];
+                vertex.x = FloatToHalf(particles.positionX[i] + particles.velocityX[i] * lookahead);
+                vertex.y = FloatToHalf(particles.positionY[i] + particles.velocityY[i] * lookahead);
+                vertex.z = FloatToHalf(particles.positionZ[i] + particles.velocityZ[i] * lookahead);
+                vertex.size = FloatToHalf(particles.size[i]);
+                vertex.color = FadeColor(particles.color[i], particles.life[i], inverseFadeTime);
+            });
+            return written;
+        }
+
+        RenderVertexFloat3* vertices = static_cast<RenderVertexFloat3*>(out);
+        slots.ForEach([&](size_t i) {
+            RenderVertexFloat3& vertex = vertices[written++];
+            vertex.x = particles.positionX[i] + particles.velocityX[i] * lookahead;
+            vertex.y = particles.positionY[i] + particles.velocityY[i] * lookahead;
+            vertex.z = particles.positionZ[i] + particles.velocityZ[i] * lookahead;
+            vertex.color = FadeColor(particles.color[i], particles.life[i], inverseFadeTime);
+        });
+        return written;
+    }
+}
+
+size_t PackRenderVertices(const ParticleStorage& particles, float lookahead, float fadeTime,
+    RenderVertexFormat format, void* out) {
+    return PackSlots(particles, LiveSlots{ particles, 0, particles.Size() }, lookahead, fadeTime, format, out);
+}
+
+size_t PackRenderVertices(const ParticleStorage& particles, size_t begin, size_t end, float lookahead, float fadeTime,
+    RenderVertexFormat format, void* out) {
+    return PackSlots(particles, LiveSlots{ particles, begin, end }, lookahead, fadeTime, format, out);
+}
+
+size_t PackRenderVertices(const ParticleStorage& particles, const uint32_t* indices, size_t count, float lookahead,
+    float fadeTime, RenderVertexFormat format, void* out) {
+    return PackSlots(particles, ListedSlots{ indices, count }, lookahead, fadeTime, format, out);
+}
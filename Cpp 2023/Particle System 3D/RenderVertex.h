@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "ParticleStorage.h"
+
+// Layouts the renderer can upload. Each carries only what its shader reads:
+// a position, an RGBA8 color and, for billboards, a size.
+enum class RenderVertexFormat {
+    // 16 bytes: float x, y, z and the color.
+    Float3,
+    // 12 bytes: half-float x, y, z, w (w = 1) and the color.
+    Half3,
+    // 20 bytes per instance: float x, y, z, size and the color, expanded to
+    // a camera-facing quad in the vertex shader.
+    Billboard,
+    // 12 bytes per instance: Billboard with half-float x, y, z and size.
+    BillboardHalf
+};
+
+struct RenderVertexFloat3 {
+    float x, y, z;
+    uint32_t color;
+};
+
+struct RenderVertexHalf3 {
+    uint16_t x, y, z, w;
+    uint32_t color;
+};
+
+struct RenderVertexBillboard {
+    float x, y, z, size;
+    uint32_t color;
+};
+
+struct RenderVertexBillboardHalf {
+    uint16_t x, y, z, size;
+    uint32_t color;
+};
+
+inline bool IsBillboardFormat(RenderVertexFormat format) {
+    return format == RenderVertexFormat::Billboard || format == RenderVertexFormat::BillboardHalf;
+}
+
+inline size_t RenderVertexSize(RenderVertexFormat format) {
+    switch (format) {
+    case RenderVertexFormat::Half3:
+        return sizeof(RenderVertexHalf3);
+    case RenderVertexFormat::Billboard:
+        return sizeof(RenderVertexBillboard);
+    case RenderVertexFormat::BillboardHalf:
+        return sizeof(RenderVertexBillboardHalf);
+    default:
+        return sizeof(RenderVertexFloat3);
+    }
+}
+
+// Writes one vertex per live particle straight from the SoA columns into
+// out, which must have room for particles.Size() vertices, and returns the
+// number written. Positions are moved lookahead seconds along the velocity,
+// and during the last fadeTime seconds of its life a particle's alpha drops
+// linearly to zero (0 disables fading).
+size_t PackRenderVertices(const ParticleStorage& particles, float lookahead, float fadeTime,
+    RenderVertexFormat format, void* out);
+// The same for the live particles in slots [begin, end). out needs room for
+// end - begin vertices; with no free slots in the range, slot i lands at
+// vertex i - begin, so ranges can be packed in parallel.
+size_t PackRenderVertices(const ParticleStorage& particles, size_t begin, size_t end, float lookahead, float fadeTime,
+    RenderVertexFormat format, void* out);
+// The same for the particles at indices, which must be live, such as the
+// visible ones CullParticles() found. out needs room for count vertices.
+size_t PackRenderVertices(const ParticleStorage& particles, const uint32_t* indices, size_t count, float lookahead,
+    float fadeTime, RenderVertexFormat format, void* out);
@@ -0,0 +1,250 @@
+#include "ShaderManager.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace {
+    const uint32_t CACHE_MAGIC = 0x43485350; // "PSHC"
+    const uint32_t CACHE_VERSION = 1;
+
+    struct CacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        // Hash of the sources and the driver strings.
+        uint64_t key;
+        uint32_t format;
+        uint32_t length;
+    };
+
+    typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+    // 64-bit FNV-1a over the string and its terminator, so "ab" + "c" and
+    // "a" + "bc" differ.
+    uint64_t HashString(uint64_t hash, const char* text) {
+        if (text == nullptr)
+            text = "";
+        do {
+            hash = (hash ^ static_cast<unsigned char>(*text)) * 0x100000001b3ull;
+        } while (*text++ != '\0');
+        return hash;
+    }
+
+    uint64_t CacheKey(const char* vertexSource, const char* fragmentSource) {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        hash = HashString(hash, vertexSource);
+        hash = HashString(hash, fragmentSource);
+        hash = HashString(hash, reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+        hash = HashString(hash, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+        hash = HashString(hash, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+        return hash;
+    }
+
+    GLuint CompileShader(GLenum type, const char* source, const char* name) {
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, NULL);
+        glCompileShader(shader);
+
+        GLint compiled = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+        if (compiled == GL_TRUE)
+            return shader;
+
+        GLint logLength = 0;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLength);
+        std::string log(logLength > 0 ? static_cast<size_t>(logLength) : 0, '\0');
+        if (logLength > 0)
+            glGetShaderInfoLog(shader, logLength, NULL, &log[0]);
+        std::cout << "Couldn't compile the " << name << (type == GL_VERTEX_SHADER ? " vertex" : " fragment")
+            << " shader: " << log.c_str() << std::endl;
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    bool Linked(GLuint program) {
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        return linked == GL_TRUE;
+    }
+}
+
+GLuint ShaderManager::Build(const char* name, const char* vertexSource, const char* fragmentSource) {
+    auto start = std::chrono::steady_clock::now();
+    ShaderBuildTime time;
+    time.name = name;
+    time.compileMilliseconds = 0.0;
+    time.linkMilliseconds = 0.0;
+    time.fromCache = false;
+
+    std::string path = BinariesSupported() ? CachePath(name) : std::string();
+    uint64_t key = path.empty() ? 0 : CacheKey(vertexSource, fragmentSource);
+    if (!path.empty()) {
+        GLuint program = LoadBinary(path, key);
+        if (program != 0) {
+            time.linkMilliseconds = Milliseconds(std::chrono::steady_clock::now() - start).count();
+            time.fromCache = true;
+            CacheUniforms(program);
+            buildTimes.push_back(time);
+            return program;
+        }
+    }
+
+    start = std::chrono::steady_clock::now();
+    GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, vertexSource, name);
+    GLuint fragmentShader = CompileShader(GL_FRAGMENT_SHADER, fragmentSource, name);
+    time.compileMilliseconds = Milliseconds(std::chrono::steady_clock::now() - start).count();
+    if (vertexShader == 0 || fragmentShader == 0) {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return 0;
+    }
+
+    // Timed up to the status query, since drivers may link in the
+    // background until asked.
+    start = std::chrono::steady_clock::now();
+    GLuint program = glCreateProgram();
+    if (!path.empty())
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
+    bool linked = Linked(program);
+    time.linkMilliseconds = Milliseconds(std::chrono::steady_clock::now() - start).count();
+
+    glDetachShader(program, vertexShader);
+    glDetachShader(program, fragmentShader);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    if (!linked) {
+        GLint logLength = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
+        std::string log(logLength > 0 ? static_cast<size_t>(logLength) : 0, '\0');
+        if (logLength > 0)
+            glGetProgramInfoLog(program, logLength, NULL, &log[0]);
+        std::cout << "Couldn't link the " << name << " shader: " << log.c_str() << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    if (!path.empty())
+        SaveBinary(path, key, program);
+    CacheUniforms(program);
+    buildTimes.push_back(time);
+    return program;
+}
+
+GLint ShaderManager::UniformLocation(GLuint program, const char* uniform) const {
+    for (const Program& entry : programs) {
+        if (entry.id != program)
+            continue;
+        for (const Uniform& candidate : entry.uniforms) {
+            if (candidate.name == uniform)
+                return candidate.location;
+        }
+        return -1;
+    }
+    return -1;
+}
+
+void ShaderManager::ReportBuildTimes(std::ostream& out) const {
+    for (const ShaderBuildTime& time : buildTimes) {
+        if (time.fromCache)
+            out << "Shader " << time.name << ": loaded from cache in " << time.linkMilliseconds << " ms" << std::endl;
+        else
+            out << "Shader " << time.name << ": compiled in " << time.compileMilliseconds << " ms, linked in "
+                << time.linkMilliseconds << " ms" << std::endl;
+    }
+}
+
+void ShaderManager::Destroy() {
+    for (const Program& program : programs)
+        glDeleteProgram(program.id);
+    programs.clear();
+}
+
+// GL 4.1 or ARB_get_program_binary, with at least one format the driver
+// can save programs in.
+bool ShaderManager::BinariesSupported() {
+    if (glGetProgramBinary == nullptr || glProgramBinary == nullptr || glProgramParameteri == nullptr)
+        return false;
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+std::string ShaderManager::CachePath(const char* name) const {
+    if (cacheDirectory.empty())
+        return std::string();
+    return (std::filesystem::path(cacheDirectory) / (std::string(name) + ".bin")).string();
+}
+
+// Null when there is no usable binary: missing, for other sources or
+// another driver, or rejected by the driver after an update.
+GLuint ShaderManager::LoadBinary(const std::string& path, uint64_t key) {
+    std::ifstream file(path, std::ios::binary);
+    CacheHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != CACHE_MAGIC
+        || header.version != CACHE_VERSION || header.key != key || header.length == 0)
+        return 0;
+    std::vector<char> binary(header.length);
+    if (!file.read(binary.data(), header.length))
+        return 0;
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(header.length));
+    if (!Linked(program)) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+void ShaderManager::SaveBinary(const std::string& path, uint64_t key, GLuint program) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    std::vector<char> binary(static_cast<size_t>(length));
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, binary.data());
+    if (written <= 0)
+        return;
+
+    CacheHeader header;
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    header.key = key;
+    header.format = format;
+    header.length = static_cast<uint32_t>(written);
+
+    std::error_code error;
+    std::filesystem::create_directories(cacheDirectory, error);
+    std::ofstream file(path, std::ios::binary);
+    if (!file.write(reinterpret_cast<const char*>(&header), sizeof(header))
+        || !file.write(binary.data(), written))
+        std::cout << "Couldn't write " << path << std::endl;
+}
+
+// Every active uniform, so later lookups never reach GL.
+void ShaderManager::CacheUniforms(GLuint program) {
+    Program entry;
+    entry.id = program;
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<char> name(static_cast<size_t>(maxLength > 0 ? maxLength : 1));
+    for (GLint i = 0; i < count; ++i) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(program, static_cast<GLuint>(i), static_cast<GLsizei>(name.size()), &length, &size, &type,
+            name.data());
+        Uniform uniform;
+        uniform.name.assign(name.data(), static_cast<size_t>(length));
+        uniform.location = glGetUniformLocation(program, uniform.name.c_str());
+        entry.uniforms.push_back(uniform);
+    }
+    programs.push_back(entry);
+}
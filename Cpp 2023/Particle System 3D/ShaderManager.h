@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+
+// How one program was built, for spotting startup regressions.
+struct ShaderBuildTime {
+    std::string name;
+    double compileMilliseconds;
+    double linkMilliseconds;
+    // Loaded from the program binary cache; compileMilliseconds is then 0
+    // and linkMilliseconds is the time glProgramBinary() took.
+    bool fromCache;
+};
+
+// Builds the app's GLSL programs and keeps them, together with the
+// locations of their uniforms, looked up once after linking so the frame
+// loop never passes a name to GL.
+//
+// With a cache directory, a linked program is saved there with
+// glGetProgramBinary() and later startups load it with glProgramBinary()
+// instead of compiling. A cached binary is keyed on the sources and on the
+// driver's vendor, renderer and version strings, and one the driver rejects
+// is rebuilt from source and saved again.
+class ShaderManager {
+public:
+    // Where program binaries are kept; empty disables the cache.
+    std::string cacheDirectory;
+
+    ShaderManager() {}
+
+    ShaderManager(const ShaderManager&) = delete;
+    ShaderManager& operator=(const ShaderManager&) = delete;
+
+    // Compiles and links a program, or loads it from the cache, and returns
+    // it; 0 when it failed, after printing the compile or link log. name
+    // identifies the program in logs, timings and the cache, so it must be
+    // a valid file name.
+    GLuint Build(const char* name, const char* vertexSource, const char* fragmentSource);
+
+    // Location of an active uniform of a program from Build(); -1 when the
+    // program has no such uniform. Meant to be called once per uniform and
+    // kept, as it compares names.
+    GLint UniformLocation(GLuint program, const char* uniform) const;
+
+    const std::vector<ShaderBuildTime>& BuildTimes() const { return buildTimes; }
+    // One line per program with its compile and link time.
+    void ReportBuildTimes(std::ostream& out) const;
+
+    // Deletes every program; call while the context is still current.
+    void Destroy();
+
+private:
+    struct Uniform {
+        std::string name;
+        GLint location;
+    };
+
+    struct Program {
+        GLuint id;
+        std::vector<Uniform> uniforms;
+    };
+
+    std::vector<Program> programs;
+    std::vector<ShaderBuildTime> buildTimes;
+
+    static bool BinariesSupported();
+    std::string CachePath(const char* name) const;
+    GLuint LoadBinary(const std::string& path, uint64_t key);
+    void SaveBinary(const std::string& path, uint64_t key, GLuint program);
+    void CacheUniforms(GLuint program);
+};
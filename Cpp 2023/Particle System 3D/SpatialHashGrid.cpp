@@ -0,0 +1,59 @@
+#include "SpatialHashGrid.h"
+#include <algorithm>
+
+void SpatialHashGrid::Build(const float* positionX, const float* positionY, const float* positionZ, size_t count) {
+    size_t tableSize = 1024;
+    while (tableSize < count)
+        tableSize *= 2;
+    tableMask = tableSize - 1;
+    inverseCellSize = 1.0f / cellSize;
+
+    bucketStart.assign(tableSize + 1, 0);
+    particleBucket.resize(count);
+    sortedIndices.resize(count);
+
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t bucket = Bucket(CellCoordinate(positionX[i]), CellCoordinate(positionY[i]), CellCoordinate(positionZ[i]));
+        particleBucket[i] = bucket;
+        ++bucketStart[bucket + 1];
+    }
+
+    for (size_t b = 0; b < tableSize; ++b)
+        bucketStart[b + 1] += bucketStart[b];
+
+    // Scatter using bucketStart as the write cursor, which leaves every entry
+    // pointing at the end of its bucket; shifting by one restores the starts.
+    for (size_t i = 0; i < count; ++i)
+        sortedIndices[bucketStart[particleBucket[i]]++] = static_cast<uint32_t>(i);
+    for (size_t b = tableSize; b > 0; --b)
+        bucketStart[b] = bucketStart[b - 1];
+    bucketStart[0] = 0;
+}
+
+void SpatialHashGrid::CollectBuckets(const glm::vec3& center, float radius) {
+    queryBuckets.clear();
+    if (sortedIndices.empty())
+        return;
+
+    int minX = CellCoordinate(center.x - radius), maxX = CellCoordinate(center.x + radius);
+    int minY = CellCoordinate(center.y - radius), maxY = CellCoordinate(center.y + radius);
+    int minZ = CellCoordinate(center.z - radius), maxZ = CellCoordinate(center.z + radius);
+
+    double cells = static_cast<double>(maxX - minX + 1) * (maxY - minY + 1) * (maxZ - minZ + 1);
+    if (cells >= static_cast<double>(BucketCount())) {
+        // The box covers at least as many cells as there are buckets.
+        queryBuckets.resize(BucketCount());
+        for (size_t b = 0; b < queryBuckets.size(); ++b)
+            queryBuckets[b] = static_cast<uint32_t>(b);
+        return;
+    }
+
+    for (int x = minX; x <= maxX; ++x)
+        for (int y = minY; y <= maxY; ++y)
+            for (int z = minZ; z <= maxZ; ++z)
+                queryBuckets.push_back(Bucket(x, y, z));
+
+    // Several cells can hash to one bucket; visit each bucket once.
+    std::sort(queryBuckets.begin(), queryBuckets.end());
+    queryBuckets.erase(std::unique(queryBuckets.begin(), queryBuckets.end()), queryBuckets.end());
+}
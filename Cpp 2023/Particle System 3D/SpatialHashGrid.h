@@ -0,0 +1,62 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Uniform grid over particle positions, hashed into a table of at least as
+// many buckets as particles. Build() is a counting sort of particle indices by bucket,
+// so it is O(N), and each bucket's particles end up contiguous.
+class SpatialHashGrid {
+public:
+    // Takes effect at the next Build(); queries use the size of the last one.
+    float cellSize;
+
+    explicit SpatialHashGrid(float _cellSize = 0.25f) : cellSize(_cellSize), tableMask(0), inverseCellSize(1.0f / _cellSize) {}
+
+    void Build(const float* positionX, const float* positionY, const float* positionZ, size_t count);
+
+    // Calls visit(index) once for every particle in a bucket touched by the
+    // box around center. Buckets hold whole cells plus hash collisions, so
+    // visited particles may lie outside the box; callers test the distance.
+    template <typename Visitor>
+    void Query(const glm::vec3& center, float radius, Visitor visit);
+
+    size_t BucketCount() const { return tableMask + 1; }
+    size_t ParticleCount() const { return sortedIndices.size(); }
+
+private:
+    size_t tableMask;
+    float inverseCellSize;
+    // Bucket b holds sortedIndices[bucketStart[b] .. bucketStart[b + 1]).
+    std::vector<uint32_t> bucketStart;
+    std::vector<uint32_t> sortedIndices;
+    std::vector<uint32_t> particleBucket;
+    std::vector<uint32_t> queryBuckets;
+
+    // Clamped so far-away particles cannot overflow the int conversion.
+    int CellCoordinate(float position) const {
+        const float limit = 1073741824.0f;
+        float cell = std::floor(position * inverseCellSize);
+        return static_cast<int>(cell < -limit ? -limit : (cell > limit ? limit : cell));
+    }
+
+    uint32_t Bucket(int x, int y, int z) const {
+        uint32_t hash = static_cast<uint32_t>(x) * 73856093u
+            ^ static_cast<uint32_t>(y) * 19349663u
+            ^ static_cast<uint32_t>(z) * 83492791u;
+        return hash & static_cast<uint32_t>(tableMask);
+    }
+
+    void CollectBuckets(const glm::vec3& center, float radius);
+};
+
+template <typename Visitor>
+void SpatialHashGrid::Query(const glm::vec3& center, float radius, Visitor visit) {
+    CollectBuckets(center, radius);
+    for (uint32_t bucket : queryBuckets) {
+        for (uint32_t i = bucketStart[bucket]; i < bucketStart[bucket + 1]; ++i)
+            visit(static_cast<size_t>(sortedIndices[i]));
+    }
+}
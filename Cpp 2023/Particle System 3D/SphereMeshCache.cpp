@@ -0,0 +1,58 @@
+#include "SphereMeshCache.h"
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+const SphereMesh& SphereMeshCache::Get(float radius, int stacks, int sectors) {
+    std::tuple<float, int, int> key(radius, stacks, sectors);
+    auto found = meshes.find(key);
+    if (found != meshes.end())
+        return found->second;
+
+    return meshes.emplace(key, Build(radius, stacks, sectors)).first->second;
+}
+
+void SphereMeshCache::Destroy() {
+    for (auto& entry : meshes) {
+        glDeleteBuffers(1, &entry.second.vbo);
+        glDeleteVertexArrays(1, &entry.second.vao);
+    }
+    meshes.clear();
+}
+
+SphereMesh SphereMeshCache::Build(float radius, int stacks, int sectors) {
+    std::vector<glm::vec3> vertices;
+    vertices.reserve(static_cast<size_t>(stacks + 1) * (sectors + 1));
+
+    for (int i = 0; i <= stacks; ++i) {
+        float stackAngle = glm::pi<float>() / 2 - i * glm::pi<float>() / stacks;
+        float xy = radius * glm::cos(stackAngle);
+        float z = radius * glm::sin(stackAngle);
+
+        for (int j = 0; j <= sectors; ++j) {
+            float sectorAngle = j * 2 * glm::pi<float>() / sectors;
+            float x = xy * glm::cos(sectorAngle);
+            float y = xy * glm::sin(sectorAngle);
+
+            vertices.push_back(glm::vec3(x, y, z));
+        }
+    }
+
+    SphereMesh mesh;
+    mesh.vertexCount = static_cast<GLsizei>(vertices.size());
+    glGenBuffers(1, &mesh.vbo);
+    glGenVertexArrays(1, &mesh.vao);
+
+    glBindVertexArray(mesh.vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return mesh;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+#include <map>
+#include <tuple>
+
+// Point-cloud sphere centered at the origin, uploaded once to a static buffer.
+struct SphereMesh {
+    GLuint vao;
+    GLuint vbo;
+    GLsizei vertexCount;
+};
+
+// Builds each (radius, stacks, sectors) sphere the first time it is asked
+// for and hands out the same GPU mesh afterwards. Callers place the mesh
+// with the model matrix instead of baking the position into the vertices.
+class SphereMeshCache {
+public:
+    const SphereMesh& Get(float radius, int stacks, int sectors);
+
+    // Needs a current GL context.
+    void Destroy();
+
+    size_t Size() const { return meshes.size(); }
+
+private:
+    std::map<std::tuple<float, int, int>, SphereMesh> meshes;
+
+    static SphereMesh Build(float radius, int stacks, int sectors);
+};
@@ -0,0 +1,86 @@
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(size_t threadCount)
+    : currentJob(nullptr), currentInvoke(nullptr), jobCount(0), jobChunkSize(1), chunkCount(0), nextChunk(0),
+      busyWorkers(0), generation(0), stopping(false) {
+    if (threadCount == 0)
+        threadCount = std::thread::hardware_concurrency();
+    if (threadCount == 0)
+        threadCount = 1;
+
+    workers.reserve(threadCount - 1);
+    for (size_t i = 1; i < threadCount; ++i)
+        workers.emplace_back(&WorkerPool::WorkerLoop, this);
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+void WorkerPool::Run(size_t count, size_t chunkSize, const void* job, JobFunction invoke) {
+    if (count == 0)
+        return;
+    if (chunkSize == 0)
+        chunkSize = 1;
+
+    if (workers.empty() || count <= chunkSize) {
+        invoke(job, 0, count);
+        return;
+    }
+
+    std::lock_guard<std::mutex> caller(callerMutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        currentJob = job;
+        currentInvoke = invoke;
+        jobCount = count;
+        jobChunkSize = chunkSize;
+        chunkCount = (count + chunkSize - 1) / chunkSize;
+        nextChunk.store(0, std::memory_order_relaxed);
+        busyWorkers = workers.size();
+        ++generation;
+    }
+    wake.notify_all();
+
+    RunChunks();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return busyWorkers == 0; });
+    currentJob = nullptr;
+}
+
+void WorkerPool::WorkerLoop() {
+    uint64_t seenGeneration = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping)
+                return;
+            seenGeneration = generation;
+        }
+
+        RunChunks();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busyWorkers == 0)
+            finished.notify_one();
+    }
+}
+
+void WorkerPool::RunChunks() {
+    for (;;) {
+        size_t chunk = nextChunk.fetch_add(1, std::memory_order_relaxed);
+        if (chunk >= chunkCount)
+            return;
+        size_t begin = chunk * jobChunkSize;
+        size_t end = begin + jobChunkSize < jobCount ? begin + jobChunkSize : jobCount;
+        currentInvoke(currentJob, begin, end);
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads that split a range into chunks. The calling thread
+// takes part in the work, so a pool of N threads spawns N - 1 workers.
+// Several threads may share a pool: their ParallelFor() calls take turns.
+// A job must not call ParallelFor() on its own pool, which would wait for
+// itself.
+class WorkerPool {
+public:
+    // threadCount == 0 uses one thread per hardware core.
+    explicit WorkerPool(size_t threadCount = 0);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    size_t ThreadCount() const { return workers.size() + 1; }
+
+    // Calls job(begin, end) for every chunkSize-long piece of [0, count) and
+    // returns once all of them finished. Chunks are handed out on demand, so
+    // a job must not depend on which thread runs it. The job is called
+    // through a plain function pointer rather than a std::function, so a
+    // call never touches the heap.
+    template <typename Job>
+    void ParallelFor(size_t count, size_t chunkSize, const Job& job) {
+        Run(count, chunkSize, &job, [](const void* target, size_t begin, size_t end) {
+            (*static_cast<const Job*>(target))(begin, end);
+        });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    // Held by the thread in Run() for the whole job, since the job's state
+    // below is shared by every caller.
+    std::mutex callerMutex;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+
+    using JobFunction = void (*)(const void* job, size_t begin, size_t end);
+
+    const void* currentJob;
+    JobFunction currentInvoke;
+    size_t jobCount;
+    size_t jobChunkSize;
+    size_t chunkCount;
+    std::atomic<size_t> nextChunk;
+    size_t busyWorkers;
+    uint64_t generation;
+    bool stopping;
+
+    void Run(size_t count, size_t chunkSize, const void* job, JobFunction invoke);
+    void WorkerLoop();
+    void RunChunks();
+};